@@ -0,0 +1,157 @@
+/*
+ * Copyright 2016 Kai Uwe Broulik <kde@privat.broulik.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "appmenuapplet.h"
+#include "../plugin/appmenumodel.h"
+
+#include <QAction>
+#include <QElapsedTimer>
+#include <QMenu>
+#include <QQuickItem>
+#include <QQuickWindow>
+#include <QStandardItemModel>
+#include <QtTest>
+
+#define MENUCOUNT 2
+#define MENUENTRIES 20
+#define BUTTONWIDTH 60
+#define BUTTONHEIGHT 30
+#define EXPOSETIMEOUT 5000
+
+class AppMenuAppletBenchmark : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void clickToVisible();
+    void hoverSwitch();
+
+private:
+    //! the window of a shown menu is exposed through a queued window system event
+    static bool waitForExposed(QMenu *menu, bool exposed);
+
+    QStandardItemModel m_model;
+    QList<QMenu *> m_menus;
+    QList<QQuickItem *> m_buttons;
+    QQuickWindow *m_window{nullptr};
+    AppMenuApplet *m_applet{nullptr};
+};
+
+void AppMenuAppletBenchmark::initTestCase()
+{
+    //! the model exposes the menus as AppMenuModel does, through the action of every top level menu
+    for (int i = 0; i < MENUCOUNT; ++i) {
+        auto *menu = new QMenu(QStringLiteral("Menu %1").arg(i));
+
+        for (int j = 0; j < MENUENTRIES; ++j) {
+            menu->addAction(QStringLiteral("Entry %1").arg(j));
+        }
+
+        auto *item = new QStandardItem(menu->title());
+        item->setData(QVariant::fromValue(static_cast<void *>(menu->menuAction())), AppMenuModel::ActionRole);
+        m_model.appendRow(item);
+        m_menus << menu;
+    }
+
+    m_window = new QQuickWindow();
+    m_window->resize(MENUCOUNT * BUTTONWIDTH, BUTTONHEIGHT);
+    m_window->show();
+    QVERIFY(QTest::qWaitForWindowExposed(m_window));
+
+    for (int i = 0; i < MENUCOUNT; ++i) {
+        auto *button = new QQuickItem(m_window->contentItem());
+        button->setPosition(QPointF(i * BUTTONWIDTH, 0));
+        button->setSize(QSizeF(BUTTONWIDTH, BUTTONHEIGHT));
+        m_buttons << button;
+    }
+
+    m_applet = new AppMenuApplet(nullptr, QVariantList());
+    m_applet->setModel(&m_model);
+    QVERIFY(m_applet->model() == &m_model);
+}
+
+void AppMenuAppletBenchmark::cleanupTestCase()
+{
+    delete m_applet;
+    delete m_window;
+    qDeleteAll(m_menus);
+}
+
+bool AppMenuAppletBenchmark::waitForExposed(QMenu *menu, bool exposed)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    while ((menu->windowHandle() && menu->windowHandle()->isExposed()) != exposed) {
+        if (timer.hasExpired(EXPOSETIMEOUT)) {
+            return false;
+        }
+
+        QCoreApplication::processEvents();
+    }
+
+    return true;
+}
+
+void AppMenuAppletBenchmark::clickToVisible()
+{
+    QMenu *menu = m_menus.first();
+
+    QBENCHMARK {
+        m_applet->trigger(m_buttons.first(), 0);
+        QVERIFY(waitForExposed(menu, true));
+        QVERIFY(m_applet->menuIsShown());
+
+        //! closing the menu resets the current index, so the next click opens it again
+        menu->hide();
+        QVERIFY(waitForExposed(menu, false));
+        QVERIFY(!m_applet->menuIsShown());
+    }
+}
+
+void AppMenuAppletBenchmark::hoverSwitch()
+{
+    //! the qml buttons trigger the hovered menu while another one is shown
+    int current = 0;
+    m_applet->trigger(m_buttons.at(current), current);
+    QVERIFY(waitForExposed(m_menus.at(current), true));
+
+    QBENCHMARK {
+        const int next = (current + 1) % MENUCOUNT;
+
+        m_applet->trigger(m_buttons.at(next), next);
+        QVERIFY(waitForExposed(m_menus.at(next), true));
+        QVERIFY(waitForExposed(m_menus.at(current), false));
+        QCOMPARE(m_applet->currentIndex(), next);
+
+        current = next;
+    }
+
+    m_menus.at(current)->hide();
+    QVERIFY(waitForExposed(m_menus.at(current), false));
+}
+
+QTEST_MAIN(AppMenuAppletBenchmark)
+
+#include "appmenuappletbenchmark.moc"
@@ -0,0 +1,156 @@
+/*
+ * Copyright 2018  Michail Vourlakos <mvourlakos@gmail.com>
+ *
+ * This file is part of the libappletdecoration library
+ *
+ * Latte-Dock is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * Latte-Dock is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "../plugin/schemesmodel.h"
+
+#include <QCollator>
+#include <QDir>
+#include <QFile>
+#include <QSet>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QtTest>
+
+#define SCHEMECOUNT 500
+//! schemes of the local data directory that are also installed system wide
+#define OVERRIDENCOUNT 100
+#define LOADTIMEOUT 30000
+
+class SchemesModelBenchmark : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    //! the first load parses every scheme, the next ones are served by SchemesCache
+    void loadUncached();
+    void loadCached();
+
+private:
+    static bool writeScheme(const QString &path, const QString &name);
+    void loadAndVerify();
+
+    QTemporaryDir m_root;
+    QString m_localSchemes;
+    QString m_globalSchemes;
+};
+
+void SchemesModelBenchmark::initTestCase()
+{
+    QVERIFY(m_root.isValid());
+
+    //! the standard paths are resolved once per process, so they are set before any model exists
+    const QString localData = m_root.path() + "/local";
+    const QString globalData = m_root.path() + "/global";
+    qputenv("XDG_DATA_HOME", QFile::encodeName(localData));
+    qputenv("XDG_DATA_DIRS", QFile::encodeName(globalData));
+    qputenv("XDG_CACHE_HOME", QFile::encodeName(m_root.path() + "/cache"));
+
+    m_localSchemes = localData + "/color-schemes";
+    m_globalSchemes = globalData + "/color-schemes";
+    QVERIFY(QDir().mkpath(m_localSchemes));
+    QVERIFY(QDir().mkpath(m_globalSchemes));
+
+    //! names are not in file order and differ in case, so the loader has to sort them
+    for (int i = 0; i < SCHEMECOUNT; ++i) {
+        const QString file = QStringLiteral("/scheme%1.colors").arg(i);
+        const int order = (i * 7919) % SCHEMECOUNT;
+        const QString name = QStringLiteral("%1 %2").arg(i % 2 ? "scheme" : "Scheme").arg(order);
+
+        QVERIFY(writeScheme(m_localSchemes + file, name));
+
+        if (i < OVERRIDENCOUNT) {
+            QVERIFY(writeScheme(m_globalSchemes + file, QStringLiteral("Overridden %1").arg(order)));
+        }
+    }
+}
+
+bool SchemesModelBenchmark::writeScheme(const QString &path, const QString &name)
+{
+    QFile file(path);
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        return false;
+    }
+
+    file.write("[General]\nName=" + name.toUtf8() + "\n\n"
+               "[Colors:Window]\n"
+               "BackgroundNormal=239,240,241\nBackgroundAlternate=189,195,199\n"
+               "ForegroundNormal=49,54,59\nForegroundInactive=127,140,141\n\n"
+               "[Colors:Selection]\n"
+               "BackgroundNormal=61,174,233\nForegroundNormal=252,252,252\n"
+               "ForegroundPositive=39,174,96\nForegroundNeutral=246,116,0\nForegroundNegative=218,68,83\n\n"
+               "[Colors:Button]\n"
+               "BackgroundNormal=239,240,241\nForegroundNormal=49,54,59\n"
+               "DecorationHover=147,206,233\nDecorationFocus=61,174,233\n");
+
+    return true;
+}
+
+void SchemesModelBenchmark::loadAndVerify()
+{
+    SchemesModel model;
+    QSignalSpy loadingSpy(&model, &SchemesModel::loadingChanged);
+
+    QVERIFY(model.loading());
+    QVERIFY(loadingSpy.wait(LOADTIMEOUT));
+    QVERIFY(!model.loading());
+
+    //! the first row is the current scheme
+    QCOMPARE(model.rowCount(), SCHEMECOUNT + 1);
+
+    QCollator collator;
+    collator.setCaseSensitivity(Qt::CaseInsensitive);
+    QSet<QString> files;
+
+    for (int row = 1; row < model.rowCount(); ++row) {
+        const QModelIndex index = model.index(row, 0);
+        const QString file = index.data(Qt::UserRole + 4).toString();
+
+        //! installed schemes are overridden by the local ones with the same file name
+        QVERIFY(file.startsWith(m_localSchemes));
+        QVERIFY(!files.contains(file));
+        QCOMPARE(model.indexOf(file), row);
+        files << file;
+
+        if (row > 1) {
+            QVERIFY(collator.compare(model.index(row - 1, 0).data().toString(), index.data().toString()) <= 0);
+        }
+    }
+}
+
+void SchemesModelBenchmark::loadUncached()
+{
+    QBENCHMARK_ONCE {
+        loadAndVerify();
+    }
+}
+
+void SchemesModelBenchmark::loadCached()
+{
+    QBENCHMARK {
+        loadAndVerify();
+    }
+}
+
+QTEST_GUILESS_MAIN(SchemesModelBenchmark)
+
+#include "schemesmodelbenchmark.moc"
@@ -2,7 +2,7 @@
 #cmakedefine01 HAVE_X11
 
 /* Define if you have LibTaskManager at all */
-// #cmakedefine01 HAVE_LibTaskManager)
+#cmakedefine01 HAVE_LibTaskManager
 
 #cmakedefine KF5_CURRENTMINOR_VERSION @KF5_CURRENTMINOR_VERSION@
 
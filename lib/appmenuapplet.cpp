@@ -23,6 +23,7 @@
 #include <config-appmenu.h>
 
 #include "decorationpalette.h"
+#include "viewserviceowner.h"
 #include "../plugin/appmenumodel.h"
 
 #include <QAction>
@@ -30,41 +31,41 @@
 #include <QMenu>
 #include <QMouseEvent>
 #include <QQuickItem>
-#include <QDBusConnection>
-#include <QDBusConnectionInterface>
 #include <QTimer>
 #include <QQuickWindow>
 #include <QScreen>
 
 #include <KWindowSystem>
 
-int AppMenuApplet::s_refs = 0;
-namespace
-{
-QString viewService()
-{
-    return QStringLiteral("org.kde.kappmenuview");
-}
-}
+#include <algorithm>
+
+#define WARMUPINTERVAL 500
+#define FRAMEINTERVAL 16
+
+int AppMenuApplet::s_paletteGenerations = 0;
 
 AppMenuApplet::AppMenuApplet(QObject *parent, const QVariantList &data)
-    : Plasma::Applet(parent, data)
+    : Plasma::Applet(parent, data),
+      m_constructedAt(monotonicNsecs())
 {
-#if LibTaskManager_CURRENTMINOR_VERSION < 19 /*5.19*/
+#if HAVE_LibTaskManager && LibTaskManager_CURRENTMINOR_VERSION < 19 /*5.19*/
     // Disable for Plasma Desktop < 5.19
     if (KWindowSystem::isPlatformWayland()) {
         return;
     }
 #endif
 
-    ++s_refs;
+    ViewServiceOwner::self()->acquire();
 
-    //if we're the first, regster the service
-    if (s_refs == 1) {
-        QDBusConnection::sessionBus().interface()->registerService(viewService(),
-                                                                   QDBusConnectionInterface::QueueService,
-                                                                   QDBusConnectionInterface::DontAllowReplacement);
-    }
+    //! native windows of the top level menus are created when the model
+    //! settles and not on their first trigger
+    m_warmUpTimer.setSingleShot(true);
+    m_warmUpTimer.setInterval(WARMUPINTERVAL);
+    connect(&m_warmUpTimer, &QTimer::timeout, this, &AppMenuApplet::warmUpMenus);
+
+    m_hoverSwitchTimer.setSingleShot(true);
+    m_hoverSwitchTimer.setTimerType(Qt::PreciseTimer);
+    connect(&m_hoverSwitchTimer, &QTimer::timeout, this, &AppMenuApplet::onHoverSwitchTimeout);
 
     /*it registers or unregisters the service when the destroyed value of the applet change,
       and not in the dtor, because:
@@ -73,19 +74,13 @@ AppMenuApplet::AppMenuApplet(QObject *parent, const QVariantList &data)
       another destroyedchanged and destroyed will be false.
       When this happens, if we are the only appmenu applet existing, the dbus interface
       will have to be registered again*/
-    connect(this, &Applet::destroyedChanged, this, [this](bool destroyed) {
+    connect(this, &Applet::destroyedChanged, this, [](bool destroyed) {
         if (destroyed) {
-            //if we were the last, unregister
-            if (--s_refs == 0) {
-                QDBusConnection::sessionBus().interface()->unregisterService(viewService());
-            }
+            //if we were the last, the service is unregistered
+            ViewServiceOwner::self()->release();
         } else {
-            //if we're the first, regster the service
-            if (++s_refs == 1) {
-                QDBusConnection::sessionBus().interface()->registerService(viewService(),
-                                                                           QDBusConnectionInterface::QueueService,
-                                                                           QDBusConnectionInterface::DontAllowReplacement);
-            }
+            //if we're the first, the service is registered
+            ViewServiceOwner::self()->acquire();
         }
     });
 }
@@ -103,10 +98,34 @@ QObject *AppMenuApplet::model() const
 
 void AppMenuApplet::setModel(QObject *model)
 {
-    QAbstractListModel *appmodel = qobject_cast<QAbstractListModel *>(model);
+    QAbstractItemModel *appmodel = qobject_cast<QAbstractItemModel *>(model);
 
     if (appmodel && m_model != appmodel) {
+        if (m_model) {
+            disconnect(m_model, nullptr, &m_warmUpTimer, nullptr);
+            disconnect(m_model, nullptr, this, nullptr);
+        }
+
         m_model = appmodel;
+
+        connect(m_model, &QAbstractItemModel::modelReset, &m_warmUpTimer, static_cast<void (QTimer::*)()>(&QTimer::start));
+        connect(m_model, &QAbstractItemModel::rowsInserted, &m_warmUpTimer, static_cast<void (QTimer::*)()>(&QTimer::start));
+
+        connect(m_model, &QAbstractItemModel::modelReset, this, &AppMenuApplet::invalidateHitTestIndex);
+        connect(m_model, &QAbstractItemModel::rowsInserted, this, &AppMenuApplet::invalidateHitTestIndex);
+        connect(m_model, &QAbstractItemModel::rowsRemoved, this, &AppMenuApplet::invalidateHitTestIndex);
+        connect(m_model, &QAbstractItemModel::dataChanged, this, &AppMenuApplet::invalidateHitTestIndex);
+        invalidateHitTestIndex();
+
+        m_tracer.setTracer(m_model->property("tracer").value<QObject *>());
+        m_latencyStats = m_model->property("latencyStats").value<QObject *>();
+
+        if (m_firstFrameUsecs >= 0) {
+            QMetaObject::invokeMethod(m_model, "scheduleInitialWindow");
+        }
+
+        ViewServiceOwner::self()->setInstrumentation(m_latencyStats, m_tracer.tracer());
+        reportFirstFrame();
         emit modelChanged();
     }
 }
@@ -150,16 +169,45 @@ void AppMenuApplet::setMenuColorScheme(const QString &scheme)
 
     m_menuColorScheme = scheme;
 
+    if (m_decorationPalette) {
+        disconnect(m_decorationPalette.data(), nullptr, this, nullptr);
+        m_decorationPalette.reset();
+    }
+
     if (!m_menuColorScheme.isEmpty()) {
-        m_decorationPalette->deleteLater();
-        m_decorationPalette = new DecorationPalette(scheme);
-    } else {
-        m_decorationPalette->deleteLater();
+        m_decorationPalette = DecorationPalette::instance(scheme);
+        connect(m_decorationPalette.data(), &DecorationPalette::changed, this, &AppMenuApplet::onPaletteChanged);
     }
 
+    onPaletteChanged();
+
     emit menuColorSchemeChanged();
 }
 
+void AppMenuApplet::onPaletteChanged()
+{
+    //! generations are unique between all applets because they may share the same menus
+    m_paletteGeneration = ++s_paletteGenerations;
+
+    if (m_currentMenu && m_menuVisible) {
+        applyPalette(m_currentMenu);
+    }
+}
+
+void AppMenuApplet::applyPalette(QMenu *menu) const
+{
+    //! setting a palette propagates a PaletteChange through the entire menu,
+    //! so it is applied only when the menu has not received the current one yet
+    static const char *generationProperty = "_appmenu_palette_generation";
+
+    if (menu->property(generationProperty).toInt() == m_paletteGeneration) {
+        return;
+    }
+
+    menu->setPalette(m_decorationPalette ? m_decorationPalette->palette() : QPalette());
+    menu->setProperty(generationProperty, m_paletteGeneration);
+}
+
 QQuickItem *AppMenuApplet::buttonGrid() const
 {
     return m_buttonGrid;
@@ -168,11 +216,126 @@ QQuickItem *AppMenuApplet::buttonGrid() const
 void AppMenuApplet::setButtonGrid(QQuickItem *buttonGrid)
 {
     if (m_buttonGrid != buttonGrid) {
+        if (m_buttonGrid) {
+            disconnect(m_buttonGrid, nullptr, this, nullptr);
+        }
+
         m_buttonGrid = buttonGrid;
+
+        if (m_buttonGrid) {
+            //! the grid is usually not in a window yet when it is set
+            connect(m_buttonGrid, &QQuickItem::windowChanged, this, &AppMenuApplet::followFirstFrame);
+            followFirstFrame(m_buttonGrid->window());
+
+            //! the buttons are laid out in a single row, so any change of their
+            //! geometry or visibility changes the grid size too
+            connect(m_buttonGrid, &QQuickItem::childrenChanged, this, &AppMenuApplet::invalidateHitTestIndex);
+            connect(m_buttonGrid, &QQuickItem::widthChanged, this, &AppMenuApplet::invalidateHitTestIndex);
+            connect(m_buttonGrid, &QQuickItem::heightChanged, this, &AppMenuApplet::invalidateHitTestIndex);
+        }
+
+        invalidateHitTestIndex();
         emit buttonGridChanged();
     }
 }
 
+void AppMenuApplet::followFirstFrame(QQuickWindow *window)
+{
+    if (!window || m_firstFrameUsecs >= 0) {
+        return;
+    }
+
+    disconnect(m_firstFrameConnection);
+
+    //! frames are swapped in the render thread, the connection is queued
+    m_firstFrameConnection = connect(window, &QQuickWindow::frameSwapped, this, [this]() {
+        disconnect(m_firstFrameConnection);
+        m_firstFrameUsecs = (monotonicNsecs() - m_constructedAt) / 1000;
+        reportFirstFrame();
+
+        //! the menu of the active window is imported only after the empty bar was shown
+        if (m_model) {
+            QMetaObject::invokeMethod(m_model, "scheduleInitialWindow");
+        }
+    });
+}
+
+void AppMenuApplet::reportFirstFrame()
+{
+    if (m_firstFrameReported || m_firstFrameUsecs < 0 || !m_latencyStats) {
+        return;
+    }
+
+    QMetaObject::invokeMethod(m_latencyStats, "addSample", Qt::DirectConnection,
+                              Q_ARG(QString, QStringLiteral("firstPanelFrame")), Q_ARG(qint64, m_firstFrameUsecs));
+
+    m_firstFrameReported = true;
+}
+
+void AppMenuApplet::invalidateHitTestIndex()
+{
+    m_hitTestIndexDirty = true;
+}
+
+void AppMenuApplet::rebuildHitTestIndex()
+{
+    m_hitTestIndexDirty = false;
+    m_buttonExtents.clear();
+
+    if (!m_buttonGrid) {
+        return;
+    }
+
+    const auto children = m_buttonGrid->childItems();
+
+    for (auto *item : children) {
+        if (!item->isVisible() || item->width() <= 0 || item->height() <= 0) {
+            continue;
+        }
+
+        bool ok;
+        const int buttonIndex = item->property("buttonIndex").toInt(&ok);
+
+        if (ok) {
+            m_buttonExtents << ButtonExtent{QRectF(item->x(), item->y(), item->width(), item->height()), buttonIndex};
+        }
+    }
+
+    std::sort(m_buttonExtents.begin(), m_buttonExtents.end(), [](const ButtonExtent &a, const ButtonExtent &b) {
+        return a.rect.left() < b.rect.left();
+    });
+}
+
+void AppMenuApplet::onHoverSwitchTimeout()
+{
+    if (m_menuVisible && m_hoveredIndex >= 0 && m_hoveredIndex != m_currentIndex) {
+        requestActivateIndexFrom(m_hoveredIndex, QStringLiteral("menuHoverSwitch"));
+    }
+}
+
+void AppMenuApplet::requestActivateIndexFrom(int index, const QString &openingSample)
+{
+    //! the qml side answers synchronously by calling trigger()
+    m_nextOpeningSample = openingSample;
+    emit requestActivateIndex(index);
+    m_nextOpeningSample.clear();
+}
+
+int AppMenuApplet::buttonIndexAt(const QPointF &buttonGridLocalPos) const
+{
+    auto it = std::upper_bound(m_buttonExtents.cbegin(), m_buttonExtents.cend(), buttonGridLocalPos.x(), [](qreal x, const ButtonExtent &extent) {
+        return x < extent.rect.left();
+    });
+
+    if (it == m_buttonExtents.cbegin()) {
+        return -1;
+    }
+
+    --it;
+
+    return it->rect.contains(buttonGridLocalPos) ? it->index : -1;
+}
+
 QMenu *AppMenuApplet::createMenu(int idx) const
 {
     QMenu *menu = nullptr;
@@ -192,16 +355,61 @@ QMenu *AppMenuApplet::createMenu(int idx) const
         }
     }
 
-    if (menu && m_decorationPalette) {
-        menu->setPalette(m_decorationPalette->palette());
+    if (menu) {
+        applyPalette(menu);
     }
 
     return menu;
 }
 
+void AppMenuApplet::warmUpMenus()
+{
+    m_warmUpQueue.clear();
+
+    if (!m_model) {
+        return;
+    }
+
+    const int count = (view() == CompactView) ? 1 : m_model->rowCount();
+
+    for (int i = 0; i < count; ++i) {
+        QMenu *menu = createMenu(i);
+
+        if (menu && !menu->windowHandle()) {
+            m_warmUpQueue << menu;
+        }
+    }
+
+    warmUpNextMenu();
+}
+
+void AppMenuApplet::warmUpNextMenu()
+{
+    //! one menu per event loop iteration in order to not block the panel
+    while (!m_warmUpQueue.isEmpty()) {
+        QPointer<QMenu> menu = m_warmUpQueue.takeFirst();
+
+        if (!menu || menu->windowHandle() || menu == m_currentMenu) {
+            continue;
+        }
+
+        menu->winId(); //create window handle
+        menu->ensurePolished();
+        menu->adjustSize();
+
+        if (!m_warmUpQueue.isEmpty()) {
+            QTimer::singleShot(0, this, &AppMenuApplet::warmUpNextMenu);
+        }
+
+        return;
+    }
+}
+
 void AppMenuApplet::onMenuAboutToHide()
 {
     m_menuVisible = false;
+    m_hoveredIndex = -1;
+    m_hoverSwitchTimer.stop();
     setCurrentIndex(-1);
 
     if (!m_currentMenu) {
@@ -215,6 +423,13 @@ void AppMenuApplet::onMenuAboutToHide()
     //! is a bit broken because there case that buttons appear hovered without really be hovered.
     QHoverEvent e(QEvent::Leave, QPoint(-5,-5),  QPoint(2, 2));
     QCoreApplication::instance()->sendEvent(m_currentMenu->windowHandle()->transientParent(), &e);
+
+    //! the menu may be shown next from another applet
+    disconnect(m_currentMenu, &QMenu::aboutToHide, this, &AppMenuApplet::onMenuAboutToHide);
+    disconnect(m_currentMenu->windowHandle(), &QWindow::widthChanged, this, &AppMenuApplet::repositionMenu);
+    disconnect(m_currentMenu->windowHandle(), &QWindow::heightChanged, this, &AppMenuApplet::repositionMenu);
+    m_currentMenu->removeEventFilter(this);
+    m_currentMenu->windowHandle()->removeEventFilter(this);
 }
 
 void AppMenuApplet::repositionMenu()
@@ -272,10 +487,25 @@ void AppMenuApplet::trigger(QQuickItem *ctx, int idx)
         return;
     }
 
+    TracerSpan span(m_tracer, QStringLiteral("AppMenuApplet::trigger"));
+
     if (!ctx || !ctx->window() || !ctx->window()->screen()) {
         return;
     }
 
+    // In Latte panel >= v0.10 we can access applets visual geometry
+    //! it belongs to the panel window and changes with the other applets, so it is
+    //! read once for every menu that is opened instead of being kept in the hit-test index
+    m_appletsLayoutGeometry = QRect();
+
+    if (m_buttonGrid && m_buttonGrid->window()) {
+        const QVariant appletsVisualGeomVariant = m_buttonGrid->window()->property("_applets_layout_geometry");
+
+        if (appletsVisualGeomVariant.isValid()) {
+            m_appletsLayoutGeometry = appletsVisualGeomVariant.toRect();
+        }
+    }
+
     QMenu *actionMenu = createMenu(idx);
 
     if (actionMenu) {
@@ -299,10 +529,20 @@ void AppMenuApplet::trigger(QQuickItem *ctx, int idx)
 
         QMenu *oldMenu = m_currentMenu;
 
+        //! measured until the menu window is exposed, see eventFilter
+        //! the input that led here is set by the event filter, switches that come from
+        //! the qml buttons while a menu is shown are the wayland hover path
+        if (!m_nextOpeningSample.isEmpty()) {
+            m_openingSample = m_nextOpeningSample;
+        } else {
+            m_openingSample = (oldMenu && oldMenu != actionMenu && m_menuVisible) ? QStringLiteral("menuHoverSwitch") : QStringLiteral("menuOpen");
+        }
+
+        m_openingBegin = monotonicNsecs();
+
         QPoint pos = ctx->window()->mapToGlobal(ctx->mapToScene(QPointF()).toPoint());
         m_currentParentGeometry = QRect(pos, QSize(ctx->width(), ctx->height()));
 
-        bool firstmenuinitialization{m_currentMenu != actionMenu};
         m_currentMenu = actionMenu;
 
         if (view() == FullView) {
@@ -314,16 +554,17 @@ void AppMenuApplet::trigger(QQuickItem *ctx, int idx)
         //! at all and wayland is complaining
         actionMenu->winId();//create window handle
         actionMenu->windowHandle()->setTransientParent(ctx->window());
+        actionMenu->windowHandle()->installEventFilter(this);
         pos = proposedPos(actionMenu, m_currentParentGeometry);
 
-        if (firstmenuinitialization) {
-            connect(actionMenu, &QMenu::aboutToHide, this, &AppMenuApplet::onMenuAboutToHide, Qt::UniqueConnection);
-            //! update menu positioning if menu width/height changed
-            connect(actionMenu->windowHandle(), &QWindow::heightChanged, this, &AppMenuApplet::repositionMenu);
-            connect(actionMenu->windowHandle(), &QWindow::widthChanged, this, &AppMenuApplet::repositionMenu);
-        }
+        //! menus are shared with the other applets that show the same window menu,
+        //! so they are followed only while this applet shows them
+        connect(actionMenu, &QMenu::aboutToHide, this, &AppMenuApplet::onMenuAboutToHide, Qt::UniqueConnection);
+        //! update menu positioning if menu width/height changed
+        connect(actionMenu->windowHandle(), &QWindow::heightChanged, this, &AppMenuApplet::repositionMenu, Qt::UniqueConnection);
+        connect(actionMenu->windowHandle(), &QWindow::widthChanged, this, &AppMenuApplet::repositionMenu, Qt::UniqueConnection);
 
-        if (KWindowSystem::isPlatformX11()) {
+        if (!KWindowSystem::isPlatformWayland()) {
             actionMenu->popup(pos);
         }
 
@@ -335,6 +576,8 @@ void AppMenuApplet::trigger(QQuickItem *ctx, int idx)
             disconnect(oldMenu->windowHandle(), &QWindow::widthChanged, this, &AppMenuApplet::repositionMenu);
             disconnect(oldMenu->windowHandle(), &QWindow::heightChanged, this, &AppMenuApplet::repositionMenu);
             disconnect(oldMenu, &QObject::destroyed, this, &AppMenuApplet::menuIsShownChanged);
+            oldMenu->removeEventFilter(this);
+            oldMenu->windowHandle()->removeEventFilter(this);
             oldMenu->hide();
         }
 
@@ -343,6 +586,9 @@ void AppMenuApplet::trigger(QQuickItem *ctx, int idx)
         }
 
         setCurrentIndex(idx);
+        //! hovering starts again from the shown menu, e.g. after a keyboard switch
+        //! the pointer can return to the button it was resting on
+        m_hoveredIndex = idx;
         m_menuVisible = true;
 
         emit menuIsShownChanged();
@@ -360,9 +606,23 @@ void AppMenuApplet::trigger(QQuickItem *ctx, int idx)
 // FIXME TODO doesn't work on submenu
 bool AppMenuApplet::eventFilter(QObject *watched, QEvent *event)
 {
+    if (event->type() == QEvent::Expose) {
+        if (m_openingBegin > 0 && m_currentMenu && watched == m_currentMenu->windowHandle() && m_currentMenu->windowHandle()->isExposed()) {
+            if (m_latencyStats) {
+                QMetaObject::invokeMethod(m_latencyStats, "addSample", Qt::DirectConnection,
+                                          Q_ARG(QString, m_openingSample), Q_ARG(qint64, (monotonicNsecs() - m_openingBegin) / 1000));
+            }
+
+            m_openingBegin = 0;
+        }
+
+        return false;
+    }
+
     auto *menu = qobject_cast<QMenu *>(watched);
 
-    if (!menu) {
+    //! only the menu that this applet shows, menus are shared between applets
+    if (!menu || menu != m_currentMenu || !m_menuVisible) {
         return false;
     }
 
@@ -372,7 +632,7 @@ bool AppMenuApplet::eventFilter(QObject *watched, QEvent *event)
         // TODO right to left languages
         if (e->key() == Qt::Key_Left) {
             int desiredIndex = m_currentIndex - 1;
-            emit requestActivateIndex(desiredIndex);
+            requestActivateIndexFrom(desiredIndex, QStringLiteral("menuKeyboardSwitch"));
             return true;
         } else if (e->key() == Qt::Key_Right) {
             if (menu->activeAction() && menu->activeAction()->menu()) {
@@ -380,7 +640,7 @@ bool AppMenuApplet::eventFilter(QObject *watched, QEvent *event)
             }
 
             int desiredIndex = m_currentIndex + 1;
-            emit requestActivateIndex(desiredIndex);
+            requestActivateIndexFrom(desiredIndex, QStringLiteral("menuKeyboardSwitch"));
             return true;
         }
 
@@ -395,12 +655,14 @@ bool AppMenuApplet::eventFilter(QObject *watched, QEvent *event)
         const QPointF &windowLocalPos = m_buttonGrid->window()->mapFromGlobal(e->globalPos());
         QPointF buttonGridLocalPos = m_buttonGrid->mapFromScene(windowLocalPos);
 
-        // In Latte panel >= v0.10 we can access applets visual geometry
-        QVariant appletsVisualGeomVariant = m_buttonGrid->window() ? m_buttonGrid->window()->property("_applets_layout_geometry") : QVariant();
+        if (m_hitTestIndexDirty) {
+            rebuildHitTestIndex();
+        }
+
         QRect windowVisualGeom = m_buttonGrid->window()->geometry();
 
-        if (appletsVisualGeomVariant.isValid()) {
-            QRect appletsVisualGeom = appletsVisualGeomVariant.toRect();
+        if (m_appletsLayoutGeometry.isValid()) {
+            QRect appletsVisualGeom = m_appletsLayoutGeometry;
             appletsVisualGeom.moveTopLeft(windowVisualGeom.topLeft());
             windowVisualGeom = appletsVisualGeom;
         }
@@ -413,20 +675,21 @@ bool AppMenuApplet::eventFilter(QObject *watched, QEvent *event)
             }
         }
 
-        auto *item = m_buttonGrid->childAt(buttonGridLocalPos.x(), buttonGridLocalPos.y());
+        const int buttonIndex = buttonIndexAt(buttonGridLocalPos);
 
-        if (!item) {
+        //! the pointer moves many times over the same button
+        if (buttonIndex < 0 || buttonIndex == m_hoveredIndex) {
             return false;
         }
 
-        bool ok;
-        const int buttonIndex = item->property("buttonIndex").toInt(&ok);
+        m_hoveredIndex = buttonIndex;
 
-        if (!ok) {
-            return false;
+        //! buttons that the pointer only passes through during a frame are never opened
+        if (!m_hoverSwitchTimer.isActive()) {
+            QScreen *screen = m_buttonGrid->window()->screen();
+            const qreal refreshRate = screen ? screen->refreshRate() : 0;
+            m_hoverSwitchTimer.start(refreshRate > 0 ? qMax(1, qRound(1000 / refreshRate)) : FRAMEINTERVAL);
         }
-
-        emit requestActivateIndex(buttonIndex);
     } else if (event->type() == QEvent::Leave) {
         if (!m_buttonGrid || !m_buttonGrid->window()) {
             return false;
@@ -437,7 +700,3 @@ bool AppMenuApplet::eventFilter(QObject *watched, QEvent *event)
 
     return false;
 }
-
-K_EXPORT_PLASMA_APPLET_WITH_JSON(appmenu, AppMenuApplet, "metadata.json")
-
-#include "appmenuapplet.moc"
@@ -22,10 +22,17 @@
 #pragma once
 
 #include <Plasma/Applet>
-#include <QAbstractListModel>
+#include <QAbstractItemModel>
 #include <QPointer>
+#include <QRectF>
+#include <QSharedPointer>
+#include <QTimer>
+#include <QVector>
+
+#include "tracerspan.h"
 
 class QQuickItem;
+class QQuickWindow;
 class QMenu;
 class AppMenuModel;
 class DecorationPalette;
@@ -94,6 +101,17 @@ private:
     void setCurrentIndex(int currentIndex);
     void onMenuAboutToHide();
     void repositionMenu();
+    void onPaletteChanged();
+    void applyPalette(QMenu *menu) const;
+    void warmUpMenus();
+    void warmUpNextMenu();
+    void invalidateHitTestIndex();
+    void rebuildHitTestIndex();
+    int buttonIndexAt(const QPointF &buttonGridLocalPos) const;
+    void onHoverSwitchTimeout();
+    void requestActivateIndexFrom(int index, const QString &openingSample);
+    void followFirstFrame(QQuickWindow *window);
+    void reportFirstFrame();
 
     bool inPanel() const;
 
@@ -101,7 +119,9 @@ private:
 
 private:
     QString m_menuColorScheme;
-    QPointer<DecorationPalette> m_decorationPalette;
+    QSharedPointer<DecorationPalette> m_decorationPalette;
+    //! menus that carry a different generation need the current palette
+    int m_paletteGeneration{0};
 
     bool m_menuVisible{false};
 
@@ -111,6 +131,38 @@ private:
     QRect m_currentParentGeometry;
     QPointer<QMenu> m_currentMenu;
     QPointer<QQuickItem> m_buttonGrid;
-    QPointer<QAbstractListModel> m_model;
-    static int s_refs;
+    QPointer<QAbstractItemModel> m_model;
+
+    //! button rectangles in buttonGrid coordinates sorted by their left edge,
+    //! used while the user hovers over the buttons with an open menu
+    struct ButtonExtent {
+        QRectF rect;
+        int index;
+    };
+
+    bool m_hitTestIndexDirty{true};
+    int m_hoveredIndex{-1};
+    QVector<ButtonExtent> m_buttonExtents;
+    //! Latte applets layout geometry, read when a menu is triggered
+    QRect m_appletsLayoutGeometry;
+    //! hovered buttons are opened at most once per frame
+    QTimer m_hoverSwitchTimer;
+
+    QTimer m_warmUpTimer;
+    QList<QPointer<QMenu>> m_warmUpQueue;
+    TracerHandle m_tracer;
+    QPointer<QObject> m_latencyStats;
+
+    //! time from construction to the first frame of the panel
+    qint64 m_constructedAt{0};
+    qint64 m_firstFrameUsecs{-1};
+    bool m_firstFrameReported{false};
+    QMetaObject::Connection m_firstFrameConnection;
+
+    //! menu opening that is measured until its window is exposed
+    QString m_openingSample;
+    //! sample name for the input that is requesting the next menu, see requestActivateIndexFrom
+    QString m_nextOpeningSample;
+    qint64 m_openingBegin{0};
+    static int s_paletteGenerations;
 };
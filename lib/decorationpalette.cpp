@@ -26,32 +26,124 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <KSharedConfig>
 #include <KColorScheme>
 
+#include <QCryptographicHash>
 #include <QDebug>
+#include <QFile>
+#include <QHash>
+#include <QList>
 #include <QPalette>
 #include <QFileInfo>
 #include <QStandardPaths>
+#include <QWeakPointer>
 
+#define FILECHANGEDINTERVAL 250
+#define RECENTPALETTESSIZE 8
 
-DecorationPalette::DecorationPalette(const QString &colorScheme)
-    : m_colorScheme(QFileInfo(colorScheme).isAbsolute()
-                    ? colorScheme
-                    : QStandardPaths::locate(QStandardPaths::GenericConfigLocation, colorScheme))
+namespace {
+//! color scheme names to the files that were located for them
+QHash<QString, QString> s_locatedFiles;
+
+QStringList wmGroups()
+{
+    return {QStringLiteral("WM"), QStringLiteral("Colors:Window")};
+}
+
+//! groups that KColorScheme reads in order to create the application palette,
+//! kdeglobals contains many more that are irrelevant for the palette
+QStringList paletteGroups(const KSharedConfigPtr &config)
+{
+    QStringList groups;
+
+    for (const auto &group : config->groupList()) {
+        if (group.startsWith(QStringLiteral("Colors:"))
+                || group.startsWith(QStringLiteral("ColorEffects:"))
+                || group == QStringLiteral("KDE")) {
+            groups << group;
+        }
+    }
+
+    groups.sort();
+    return groups;
+}
+}
+
+QSharedPointer<DecorationPalette> DecorationPalette::instance(const QString &colorScheme)
 {
-    if (m_colorScheme.isEmpty() && colorScheme == QStringLiteral("kdeglobals")) {
+    static QHash<QString, QWeakPointer<DecorationPalette>> s_palettes;
+    //! most recently used palettes are kept alive even when no applet uses them,
+    //! so switching back and forth between schemes does not parse them again
+    static QList<QSharedPointer<DecorationPalette>> s_recentPalettes;
+
+    const QString file = schemeFile(colorScheme);
+
+    QSharedPointer<DecorationPalette> palette = s_palettes.value(file).toStrongRef();
+
+    if (!palette) {
+        palette = QSharedPointer<DecorationPalette>(new DecorationPalette(file), &QObject::deleteLater);
+        s_palettes[file] = palette;
+    }
+
+    s_recentPalettes.removeOne(palette);
+    s_recentPalettes.prepend(palette);
+
+    while (s_recentPalettes.count() > RECENTPALETTESSIZE) {
+        s_recentPalettes.removeLast();
+    }
+
+    return palette;
+}
+
+QString DecorationPalette::schemeFile(const QString &colorScheme)
+{
+    if (QFileInfo(colorScheme).isAbsolute()) {
+        return colorScheme;
+    }
+
+    if (s_locatedFiles.contains(colorScheme)) {
+        return s_locatedFiles[colorScheme];
+    }
+
+    QString file = QStandardPaths::locate(QStandardPaths::GenericConfigLocation, colorScheme);
+
+    if (file.isEmpty() && colorScheme == QStringLiteral("kdeglobals")) {
         // kdeglobals doesn't exist so create it. This is needed to monitor it using QFileSystemWatcher.
         auto config = KSharedConfig::openConfig(colorScheme, KConfig::SimpleConfig);
         KConfigGroup wmConfig(config, QStringLiteral("WM"));
         wmConfig.writeEntry("FakeEntryToKeepThisGroup", true);
         config->sync();
 
-        m_colorScheme = QStandardPaths::locate(QStandardPaths::GenericConfigLocation, colorScheme);
+        file = QStandardPaths::locate(QStandardPaths::GenericConfigLocation, colorScheme);
+    }
+
+    if (!file.isEmpty()) {
+        s_locatedFiles[colorScheme] = file;
     }
 
+    return file;
+}
+
+DecorationPalette::DecorationPalette(const QString &colorSchemeFile)
+    : m_colorScheme(colorSchemeFile)
+{
+    m_fileChangedTimer.setSingleShot(true);
+    m_fileChangedTimer.setInterval(FILECHANGEDINTERVAL);
+    connect(&m_fileChangedTimer, &QTimer::timeout, this, &DecorationPalette::onFileChanged);
+
     m_watcher.addPath(m_colorScheme);
-    connect(&m_watcher, &QFileSystemWatcher::fileChanged, [this]() {
+    connect(&m_watcher, &QFileSystemWatcher::fileChanged, this, [this]() {
+        //! the scheme may have been removed or shadowed by a local copy,
+        //! so it is located again the next time it is asked for
+        for (auto it = s_locatedFiles.begin(); it != s_locatedFiles.end();) {
+            if (it.value() == m_colorScheme) {
+                it = s_locatedFiles.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        //! files that are replaced instead of rewritten drop out of the watcher
         m_watcher.addPath(m_colorScheme);
-        update();
-        emit changed();
+        m_fileChangedTimer.start();
     });
 
     update();
@@ -117,6 +209,58 @@ QPalette DecorationPalette::palette() const
     return m_palette;
 }
 
+QByteArray DecorationPalette::groupsHash(const KSharedConfigPtr &config, const QStringList &groups)
+{
+    QCryptographicHash hash(QCryptographicHash::Md5);
+
+    for (const auto &group : groups) {
+        const QMap<QString, QString> entries = KConfigGroup(config, group).entryMap();
+        hash.addData(group.toUtf8());
+
+        for (auto it = entries.constBegin(); it != entries.constEnd(); ++it) {
+            hash.addData(it.key().toUtf8());
+            hash.addData(it.value().toUtf8());
+        }
+    }
+
+    return hash.result();
+}
+
+void DecorationPalette::onFileChanged()
+{
+    QFile file(m_colorScheme);
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    const QByteArray fileHash = QCryptographicHash::hash(file.readAll(), QCryptographicHash::Md5);
+
+    if (fileHash == m_fileHash) {
+        //! identical rewrite
+        return;
+    }
+
+    m_fileHash = fileHash;
+
+    auto config = KSharedConfig::openConfig(m_colorScheme, KConfig::SimpleConfig);
+    config->reparseConfiguration();
+
+    const QByteArray paletteGroupsHash = groupsHash(config, paletteGroups(config));
+    const QByteArray wmGroupsHash = groupsHash(config, wmGroups());
+
+    if (paletteGroupsHash != m_paletteGroupsHash) {
+        update();
+        emit changed();
+    } else if (wmGroupsHash != m_wmGroupsHash) {
+        //! only the window manager colors changed, the application palette and
+        //! the menus that use it are still valid
+        updateWindowManagerColors(config);
+        m_wmGroupsHash = wmGroupsHash;
+        emit windowManagerColorsChanged();
+    }
+}
+
 void DecorationPalette::update()
 {
     auto config = KSharedConfig::openConfig(m_colorScheme, KConfig::SimpleConfig);
@@ -127,7 +271,27 @@ void DecorationPalette::update()
         return;
     }
 
+    QFile file(m_colorScheme);
+
+    if (file.open(QIODevice::ReadOnly)) {
+        m_fileHash = QCryptographicHash::hash(file.readAll(), QCryptographicHash::Md5);
+    }
+
+    m_paletteGroupsHash = groupsHash(config, paletteGroups(config));
+    m_wmGroupsHash = groupsHash(config, wmGroups());
+
+    updatePalette(config);
+    updateWindowManagerColors(config);
+}
+
+void DecorationPalette::updatePalette(const KSharedConfigPtr &config)
+{
     m_palette = KColorScheme::createApplicationPalette(config);
+}
+
+void DecorationPalette::updateWindowManagerColors(const KSharedConfigPtr &config)
+{
+    KConfigGroup wmConfig(config, QStringLiteral("WM"));
 
     m_activeFrameColor        = wmConfig.readEntry("frame", m_palette.color(QPalette::Active, QPalette::Background));
     m_inactiveFrameColor      = wmConfig.readEntry("inactiveFrame", m_activeFrameColor);
@@ -138,5 +302,4 @@ void DecorationPalette::update()
 
     KConfigGroup windowColorsConfig(config, QStringLiteral("Colors:Window"));
     m_warningForegroundColor = windowColorsConfig.readEntry("ForegroundNegative", QColor(237, 21, 2));
-
 }
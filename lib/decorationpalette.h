@@ -24,15 +24,20 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define KWIN_DECORATION_PALETTE_H
 
 #include <KDecoration2/DecorationSettings>
+#include <KSharedConfig>
 #include <QFileSystemWatcher>
 #include <QPalette>
+#include <QSharedPointer>
+#include <QTimer>
 
 
 class DecorationPalette : public QObject
 {
     Q_OBJECT
 public:
-    DecorationPalette(const QString &colorScheme);
+    //! palettes are shared between all applets of the process that use
+    //! the same color scheme file
+    static QSharedPointer<DecorationPalette> instance(const QString &colorScheme);
 
     bool isValid() const;
 
@@ -40,12 +45,30 @@ public:
     QPalette palette() const;
 
 Q_SIGNALS:
+    //! the application palette changed
     void changed();
+    //! only the colors returned by color() changed
+    void windowManagerColorsChanged();
+
 private:
+    explicit DecorationPalette(const QString &colorSchemeFile);
+
+    static QString schemeFile(const QString &colorScheme);
+    static QByteArray groupsHash(const KSharedConfigPtr &config, const QStringList &groups);
+
+    void onFileChanged();
     void update();
+    void updatePalette(const KSharedConfigPtr &config);
+    void updateWindowManagerColors(const KSharedConfigPtr &config);
 
     QString m_colorScheme;
     QFileSystemWatcher m_watcher;
+    //! editors and the colors kcm write the file several times in a row
+    QTimer m_fileChangedTimer;
+
+    QByteArray m_fileHash;
+    QByteArray m_paletteGroupsHash;
+    QByteArray m_wmGroupsHash;
 
     QPalette m_palette;
 
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2016 Kai Uwe Broulik <kde@privat.broulik.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "tracerspan.h"
+
+TracerHandle::TracerHandle(QObject *parent)
+    : QObject(parent)
+{
+}
+
+QObject *TracerHandle::tracer() const
+{
+    return m_tracer;
+}
+
+void TracerHandle::setTracer(QObject *tracer)
+{
+    if (m_tracer == tracer) {
+        return;
+    }
+
+    if (m_tracer) {
+        disconnect(m_tracer, nullptr, this, nullptr);
+    }
+
+    m_tracer = tracer;
+    m_enabled = false;
+
+    if (m_tracer) {
+        //! the tracer is only known through its meta object
+        connect(m_tracer, SIGNAL(enabledChanged(bool)), this, SLOT(setEnabled(bool)));
+        m_enabled = m_tracer->property("enabled").toBool();
+    }
+}
+
+void TracerHandle::setEnabled(bool enabled)
+{
+    m_enabled = enabled;
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright 2016 Kai Uwe Broulik <kde@privat.broulik.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <QMetaObject>
+#include <QObject>
+#include <QPointer>
+#include <QString>
+
+#include <chrono>
+
+//! same monotonic clock that the plugin instrumentation uses
+inline qint64 monotonicNsecs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//! Follows the enabled state of the tracer through its enabledChanged signal,
+//! so that spans cost a single bool test while tracing is disabled
+class TracerHandle : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TracerHandle(QObject *parent = nullptr);
+
+    QObject *tracer() const;
+    void setTracer(QObject *tracer);
+
+    bool isEnabled() const {
+        return m_enabled;
+    }
+
+private slots:
+    void setEnabled(bool enabled);
+
+private:
+    QPointer<QObject> m_tracer;
+    bool m_enabled{false};
+};
+
+//! the tracer lives in the plugin that the applet does not link against,
+//! so spans are measured here with the same clock and handed over to it
+class TracerSpan
+{
+public:
+    TracerSpan(const TracerHandle &tracer, const QString &name)
+        : m_tracer(tracer.isEnabled() ? tracer.tracer() : nullptr),
+          m_name(m_tracer ? name : QString()),
+          m_begin(m_tracer ? monotonicNsecs() : 0) {
+    }
+
+    ~TracerSpan() {
+        if (m_tracer) {
+            QMetaObject::invokeMethod(m_tracer, "addSpan", Qt::DirectConnection,
+                                      Q_ARG(QString, m_name), Q_ARG(qint64, m_begin), Q_ARG(qint64, monotonicNsecs() - m_begin));
+        }
+    }
+
+private:
+    Q_DISABLE_COPY(TracerSpan)
+
+    QPointer<QObject> m_tracer;
+    QString m_name;
+    qint64 m_begin;
+};
@@ -0,0 +1,172 @@
+/*
+ * Copyright 2016 Kai Uwe Broulik <kde@privat.broulik.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "viewserviceowner.h"
+
+#include <QDBusConnection>
+#include <QDBusConnectionInterface>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+#include <QDebug>
+
+namespace
+{
+QString viewService()
+{
+    return QStringLiteral("org.kde.kappmenuview");
+}
+
+QString latencyStatsPath()
+{
+    return QStringLiteral("/LatencyStats");
+}
+
+QString tracerPath()
+{
+    return QStringLiteral("/Tracer");
+}
+}
+
+ViewServiceOwner::ViewServiceOwner(QObject *parent)
+    : QObject(parent)
+{
+}
+
+ViewServiceOwner *ViewServiceOwner::self()
+{
+    static ViewServiceOwner s_owner;
+    return &s_owner;
+}
+
+void ViewServiceOwner::acquire()
+{
+    if (++m_refs == 1) {
+        requestName();
+        registerInstrumentation();
+    }
+}
+
+void ViewServiceOwner::release()
+{
+    if (m_refs > 0 && --m_refs == 0) {
+        unregisterInstrumentation();
+        releaseName();
+    }
+}
+
+void ViewServiceOwner::setInstrumentation(QObject *latencyStats, QObject *tracer)
+{
+    if (!m_latencyStats) {
+        m_latencyStats = latencyStats;
+    }
+
+    if (!m_tracer.tracer()) {
+        m_tracer.setTracer(tracer);
+    }
+
+    if (m_refs > 0) {
+        registerInstrumentation();
+    }
+
+    reportNameRequest();
+}
+
+void ViewServiceOwner::requestName()
+{
+    TracerSpan span(m_tracer, QStringLiteral("ViewServiceOwner::requestName"));
+
+    //! flags 0 is what registerService() sends for QueueService and DontAllowReplacement,
+    //! which the applet used before: while another process owns the name the request
+    //! waits in the queue of the bus daemon
+    QDBusPendingCall call = QDBusConnection::sessionBus().interface()->asyncCall(QStringLiteral("RequestName"), viewService(), uint(0));
+    auto *watcher = new QDBusPendingCallWatcher(call, this);
+
+    m_nameRequestBegin = monotonicNsecs();
+    m_nameRequestDuration = -1;
+
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [this](QDBusPendingCallWatcher *watcher) {
+        QDBusPendingReply<uint> reply = *watcher;
+
+        if (reply.isError()) {
+            qDebug() << "Could not request" << viewService() << reply.error().message();
+        }
+
+        //! the time that the applet construction used to block
+        m_nameRequestDuration = monotonicNsecs() - m_nameRequestBegin;
+        reportNameRequest();
+
+        watcher->deleteLater();
+    });
+}
+
+void ViewServiceOwner::releaseName()
+{
+    TracerSpan span(m_tracer, QStringLiteral("ViewServiceOwner::releaseName"));
+
+    //! messages are delivered in order, so a later RequestName is handled after this one
+    QDBusPendingCall call = QDBusConnection::sessionBus().interface()->asyncCall(QStringLiteral("ReleaseName"), viewService());
+    auto *watcher = new QDBusPendingCallWatcher(call, this);
+
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [](QDBusPendingCallWatcher *watcher) {
+        QDBusPendingReply<uint> reply = *watcher;
+
+        if (reply.isError()) {
+            qDebug() << "Could not release" << viewService() << reply.error().message();
+        }
+
+        watcher->deleteLater();
+    });
+}
+
+void ViewServiceOwner::reportNameRequest()
+{
+    if (m_nameRequestDuration < 0 || !m_latencyStats) {
+        return;
+    }
+
+    QMetaObject::invokeMethod(m_latencyStats, "addSample", Qt::DirectConnection,
+                              Q_ARG(QString, QStringLiteral("viewServiceRequestName")), Q_ARG(qint64, m_nameRequestDuration / 1000));
+
+    if (m_tracer.isEnabled() && m_tracer.tracer()) {
+        QMetaObject::invokeMethod(m_tracer.tracer(), "addSpan", Qt::DirectConnection,
+                                  Q_ARG(QString, QStringLiteral("ViewServiceOwner::requestNameReply")),
+                                  Q_ARG(qint64, m_nameRequestBegin), Q_ARG(qint64, m_nameRequestDuration));
+    }
+
+    m_nameRequestDuration = -1;
+}
+
+void ViewServiceOwner::registerInstrumentation()
+{
+    if (m_latencyStats && !QDBusConnection::sessionBus().objectRegisteredAt(latencyStatsPath())) {
+        QDBusConnection::sessionBus().registerObject(latencyStatsPath(), m_latencyStats, QDBusConnection::ExportScriptableContents);
+    }
+
+    if (m_tracer.tracer() && !QDBusConnection::sessionBus().objectRegisteredAt(tracerPath())) {
+        QDBusConnection::sessionBus().registerObject(tracerPath(), m_tracer.tracer(), QDBusConnection::ExportScriptableContents);
+    }
+}
+
+void ViewServiceOwner::unregisterInstrumentation()
+{
+    QDBusConnection::sessionBus().unregisterObject(latencyStatsPath());
+    QDBusConnection::sessionBus().unregisterObject(tracerPath());
+}
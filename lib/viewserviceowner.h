@@ -0,0 +1,65 @@
+/*
+ * Copyright 2016 Kai Uwe Broulik <kde@privat.broulik.de>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License or (at your option) version 3 or any later version
+ * accepted by the membership of KDE e.V. (or its successor approved
+ * by the membership of KDE e.V.), which shall act as a proxy
+ * defined in Section 14 of version 3 of the license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#pragma once
+
+#include <QObject>
+#include <QPointer>
+
+#include "tracerspan.h"
+
+//! Owns the org.kde.kappmenuview name on the session bus for all applets of
+//! the process. The name is requested and released asynchronously, so adding
+//! and removing applets never waits for the bus daemon.
+class ViewServiceOwner : public QObject
+{
+    Q_OBJECT
+
+public:
+    static ViewServiceOwner *self();
+
+    //! the name is owned while at least one applet is alive
+    void acquire();
+    void release();
+
+    //! statistics and tracer are shared by all models of the process, so the first
+    //! applet that provides them exports them next to the view service
+    void setInstrumentation(QObject *latencyStats, QObject *tracer);
+
+private:
+    explicit ViewServiceOwner(QObject *parent = nullptr);
+
+    void requestName();
+    void releaseName();
+    void registerInstrumentation();
+    void unregisterInstrumentation();
+    void reportNameRequest();
+
+private:
+    int m_refs{0};
+
+    //! the name is usually requested before any tracer is known
+    qint64 m_nameRequestBegin{0};
+    qint64 m_nameRequestDuration{-1};
+
+    QPointer<QObject> m_latencyStats;
+    TracerHandle m_tracer;
+};
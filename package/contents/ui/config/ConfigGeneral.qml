@@ -122,6 +122,15 @@ Item {
                 Component.onCompleted: {
                     currentIndex = schemesModel.indexOf(plasmoid.configuration.selectedScheme);
                 }
+
+                Connections {
+                    target: schemesModel
+                    onLoadingChanged: {
+                        if (!schemesModel.loading) {
+                            colorsCmbBox.currentIndex = schemesModel.indexOf(plasmoid.configuration.selectedScheme);
+                        }
+                    }
+                }
             }
         }
 
@@ -26,6 +26,8 @@
 #include <dbusmenuimporter.h>
 
 // local
+#include "perf/latencystats.h"
+#include "perf/tracer.h"
 #include "wm/waylandwindowmanager.h"
 #include "wm/x11fallbackwindowmanager.h"
 
@@ -37,10 +39,14 @@
 #include <QDBusConnectionInterface>
 #include <QDBusServiceWatcher>
 #include <QGuiApplication>
+#include <QHash>
+#include <QPair>
+#include <QSharedPointer>
 
 // KDE
 #include <KWindowSystem>
 
+#define INITIALWINDOWTIMEOUT 1000
 
 class KDBusMenuImporter : public DBusMenuImporter
 {
@@ -58,11 +64,71 @@ protected:
 
 };
 
+namespace {
+QEvent::Type resolveInitialWindowEvent()
+{
+    static const QEvent::Type s_type = static_cast<QEvent::Type>(QEvent::registerEventType());
+    return s_type;
+}
+
+//! models of all applets that show the menu of the same window share one importer,
+//! so the layout is requested and the menu tree is built once per process
+QSharedPointer<KDBusMenuImporter> sharedImporter(const QString &serviceName, const QString &menuObjectPath, bool &created)
+{
+    static QHash<QPair<QString, QString>, QWeakPointer<KDBusMenuImporter>> s_importers;
+    static bool s_cleanupConnected{false};
+    static bool s_quitting{false};
+
+    const QPair<QString, QString> key(serviceName, menuObjectPath);
+    QSharedPointer<KDBusMenuImporter> importer = s_importers.value(key).toStrongRef();
+
+    created = !importer;
+
+    if (created) {
+        importer = QSharedPointer<KDBusMenuImporter>(new KDBusMenuImporter(serviceName, menuObjectPath, nullptr), &QObject::deleteLater);
+        s_importers[key] = importer;
+
+        KDBusMenuImporter *rawImporter = importer.data();
+
+        //! cache first layer of sub menus, which we'll be popping up
+        QObject::connect(rawImporter, &DBusMenuImporter::menuUpdated, rawImporter, [rawImporter](QMenu *menu) {
+            if (!menu || menu != rawImporter->menu()) {
+                return;
+            }
+
+            for (QAction *a : menu->actions()) {
+                if (a->menu()) {
+                    rawImporter->updateMenu(a->menu());
+                }
+            }
+        });
+
+        QObject::connect(rawImporter, &QObject::destroyed, [key]() {
+            if (!s_quitting && !s_importers.value(key).toStrongRef()) {
+                s_importers.remove(key);
+            }
+        });
+
+        //! importers that are still referenced at exit may be destroyed after the
+        //! static registry, so it is emptied while the application still runs
+        if (!s_cleanupConnected && QCoreApplication::instance()) {
+            s_cleanupConnected = true;
+            QObject::connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, []() {
+                s_quitting = true;
+                s_importers.clear();
+            });
+        }
+    }
+
+    return importer;
+}
+}
+
 AppMenuModel::AppMenuModel(QObject *parent)
     : QAbstractListModel(parent),
       m_serviceWatcher(new QDBusServiceWatcher(this))
 {
-#if LibTaskManager_CURRENTMINOR_VERSION < 19
+#if HAVE_LibTaskManager && LibTaskManager_CURRENTMINOR_VERSION < 19
     // Disable for Plasma Desktop < 5.19
     if (KWindowSystem::isPlatformWayland()) {
         return;
@@ -71,6 +137,13 @@ AppMenuModel::AppMenuModel(QObject *parent)
 
     initWM();
 
+    //! the panel is painted with an empty menu first, the active window and its
+    //! menu are resolved after the first frame, see scheduleInitialWindow
+    m_initialWindowTimer.setSingleShot(true);
+    m_initialWindowTimer.setInterval(INITIALWINDOWTIMEOUT);
+    connect(&m_initialWindowTimer, &QTimer::timeout, this, &AppMenuModel::scheduleInitialWindow);
+    m_initialWindowTimer.start();
+
     connect(this, &AppMenuModel::modelNeedsUpdate, this, [this] {
         if (!m_updatePending)
         {
@@ -92,6 +165,8 @@ AppMenuModel::AppMenuModel(QObject *parent)
 
 AppMenuModel::~AppMenuModel()
 {
+    Perf::LatencyStats::self()->release(this);
+
     for (const auto &var : m_wmconnections) {
         QObject::disconnect(var);
     }
@@ -163,6 +238,44 @@ void AppMenuModel::setWinId(const QVariant &id)
     }
 }
 
+QObject *AppMenuModel::latencyStats() const
+{
+    return Perf::LatencyStats::self();
+}
+
+QObject *AppMenuModel::tracer() const
+{
+    return Perf::Tracer::self();
+}
+
+void AppMenuModel::scheduleInitialWindow()
+{
+    if (m_initialWindowScheduled) {
+        return;
+    }
+
+    m_initialWindowScheduled = true;
+    m_initialWindowTimer.stop();
+
+    //! runs when the event loop has nothing more important to do
+    QCoreApplication::postEvent(this, new QEvent(resolveInitialWindowEvent()), Qt::LowEventPriority);
+}
+
+bool AppMenuModel::event(QEvent *e)
+{
+    if (e->type() == resolveInitialWindowEvent()) {
+        Perf::TraceSpan span("AppMenuModel::resolveInitialWindow");
+
+        if (m_wm) {
+            m_wm->resolveInitialWindow();
+        }
+
+        return true;
+    }
+
+    return QAbstractListModel::event(e);
+}
+
 void AppMenuModel::initWM()
 {
 
@@ -200,6 +313,8 @@ void AppMenuModel::update()
     beginResetModel();
     endResetModel();
     m_updatePending = false;
+
+    Perf::LatencyStats::self()->mark(this, Perf::LatencyStats::ModelUpdated);
 }
 
 QHash<int, QByteArray> AppMenuModel::roleNames() const
@@ -235,9 +350,11 @@ QVariant AppMenuModel::data(const QModelIndex &index, int role) const
 
 void AppMenuModel::updateApplicationMenu(const QString &serviceName, const QString &menuObjectPath)
 {
+    Perf::LatencyStats::self()->mark(this, Perf::LatencyStats::ApplicationMenuChanged);
+
     if (m_serviceName == serviceName && m_menuObjectPath == menuObjectPath) {
         if (m_importer) {
-            QMetaObject::invokeMethod(m_importer, "updateMenu", Qt::QueuedConnection);
+            QMetaObject::invokeMethod(m_importer.data(), "updateMenu", Qt::QueuedConnection);
         }
 
         return;
@@ -249,45 +366,40 @@ void AppMenuModel::updateApplicationMenu(const QString &serviceName, const QStri
     m_menuObjectPath = menuObjectPath;
 
     if (m_importer) {
-        m_importer->deleteLater();
+        disconnect(m_importer.data(), nullptr, this, nullptr);
+        m_importer.reset();
     }
 
-    m_importer = new KDBusMenuImporter(serviceName, menuObjectPath, this);
-    QMetaObject::invokeMethod(m_importer, "updateMenu", Qt::QueuedConnection);
-
-    connect(m_importer.data(), &DBusMenuImporter::menuUpdated, this, [ = ](QMenu * menu) {
-        m_menu = m_importer->menu();
-
-        if (m_menu.isNull() || menu != m_menu) {
-            return;
-        }
+    //! importers are shared, so the menu of the previous window may stay alive
+    //! for another applet and must neither be shown nor update this model
+    if (m_menu) {
+        beginResetModel();
+        detachMenu();
+        endResetModel();
+    }
 
-        //cache first layer of sub menus, which we'll be popping up
-        for (QAction *a : m_menu->actions()) {
-            // signal dataChanged when the action changes
-            connect(a, &QAction::changed, this, [this, a] {
-                if (m_wm && m_wm->menuAvailable() && m_menu)
-                {
-                    const int actionIdx = m_menu->actions().indexOf(a);
-
-                    if (actionIdx > -1) {
-                        const QModelIndex modelIdx = index(actionIdx, 0);
-                        emit dataChanged(modelIdx, modelIdx);
-                    }
-                }
-            });
+    bool created{false};
+    m_importer = sharedImporter(serviceName, menuObjectPath, created);
 
-            connect(a, &QAction::destroyed, this, &AppMenuModel::modelNeedsUpdate);
+    if (created) {
+        //! the importer requests the root layout already during its construction
+        Perf::LatencyStats::self()->mark(this, Perf::LatencyStats::LayoutRequested);
+        QMetaObject::invokeMethod(m_importer.data(), "updateMenu", Qt::QueuedConnection);
+    } else if (m_importer->menu() && !m_importer->menu()->actions().isEmpty()) {
+        //! another applet has already imported this menu
+        QMetaObject::invokeMethod(this, "onMenuUpdated", Qt::QueuedConnection, Q_ARG(QMenu *, m_importer->menu()));
+    }
 
-            if (a->menu()) {
-                m_importer->updateMenu(a->menu());
-            }
-        }
+    connect(m_importer.data(), &DBusMenuImporter::layoutRequested, this, [this]() {
+        Perf::LatencyStats::self()->mark(this, Perf::LatencyStats::LayoutRequested);
+    });
 
-        m_wm->setMenuAvailable(true);
-        emit modelNeedsUpdate();
+    connect(m_importer.data(), &DBusMenuImporter::layoutReceived, this, [this]() {
+        Perf::LatencyStats::self()->mark(this, Perf::LatencyStats::LayoutReceived);
     });
 
+    connect(m_importer.data(), &DBusMenuImporter::menuUpdated, this, &AppMenuModel::onMenuUpdated);
+
     connect(m_importer.data(), &DBusMenuImporter::actionActivationRequested, this, [this](QAction * action) {
         // TODO submenus
         if (!m_wm || !m_wm->menuAvailable() || !m_menu) {
@@ -302,3 +414,53 @@ void AppMenuModel::updateApplicationMenu(const QString &serviceName, const QStri
         }
     });
 }
+
+void AppMenuModel::onMenuUpdated(QMenu *menu)
+{
+    if (!m_importer) {
+        return;
+    }
+
+    m_menu = m_importer->menu();
+
+    if (m_menu.isNull() || menu != m_menu) {
+        return;
+    }
+
+    Perf::LatencyStats::self()->mark(this, Perf::LatencyStats::MenuUpdated);
+
+    for (QAction *a : m_menu->actions()) {
+        // signal dataChanged when the action changes, menuUpdated is emitted for
+        // every layout update of the root menu so the connection must stay unique
+        connect(a, &QAction::changed, this, &AppMenuModel::onActionChanged, Qt::UniqueConnection);
+        connect(a, &QAction::destroyed, this, &AppMenuModel::modelNeedsUpdate, Qt::UniqueConnection);
+    }
+
+    m_wm->setMenuAvailable(true);
+    emit modelNeedsUpdate();
+}
+
+void AppMenuModel::detachMenu()
+{
+    for (QAction *a : m_menu->actions()) {
+        disconnect(a, nullptr, this, nullptr);
+    }
+
+    m_menu.clear();
+}
+
+void AppMenuModel::onActionChanged()
+{
+    QAction *action = qobject_cast<QAction *>(sender());
+
+    if (!action || !m_wm || !m_wm->menuAvailable() || !m_menu) {
+        return;
+    }
+
+    const int actionIdx = m_menu->actions().indexOf(action);
+
+    if (actionIdx > -1) {
+        const QModelIndex modelIdx = index(actionIdx, 0);
+        emit dataChanged(modelIdx, modelIdx);
+    }
+}
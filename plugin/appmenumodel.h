@@ -29,6 +29,8 @@
 #include <QStringList>
 #include <KWindowSystem>
 #include <QPointer>
+#include <QTimer>
+#include <QSharedPointer>
 #include <QRect>
 
 class QMenu;
@@ -50,6 +52,9 @@ class AppMenuModel : public QAbstractListModel
     Q_PROPERTY(QRect screenGeometry READ screenGeometry WRITE setScreenGeometry NOTIFY screenGeometryChanged)
 
     Q_PROPERTY(QVariant winId READ winId WRITE setWinId NOTIFY winIdChanged)
+
+    Q_PROPERTY(QObject *latencyStats READ latencyStats CONSTANT)
+    Q_PROPERTY(QObject *tracer READ tracer CONSTANT)
 public:
     explicit AppMenuModel(QObject *parent = nullptr);
     ~AppMenuModel() override;
@@ -81,6 +86,13 @@ public:
     QVariant winId() const;
     void setWinId(const QVariant &id);
 
+    QObject *latencyStats() const;
+    QObject *tracer() const;
+
+    //! called by the applet once the panel painted its first frame, the active
+    //! window is then resolved when the event loop is idle
+    Q_INVOKABLE void scheduleInitialWindow();
+
 signals:
     void requestActivateIndex(int index);
 
@@ -89,6 +101,8 @@ public slots:
 
 private Q_SLOTS:
     void update();
+    void onMenuUpdated(QMenu *menu);
+    void onActionChanged();
 
 signals:
     void menuAvailableChanged();
@@ -99,11 +113,19 @@ signals:
     void screenGeometryChanged();
     void winIdChanged();
 
+protected:
+    bool event(QEvent *e) override;
+
 private:
     void initWM();
+    void detachMenu();
 
 private:
     bool m_updatePending = false;
+    bool m_initialWindowScheduled = false;
+
+    //! resolves the active window even if no frame is ever reported e.g. hidden panels
+    QTimer m_initialWindowTimer;
 
     QPointer<WM::AbstractWindowManager> m_wm;
     QList<QMetaObject::Connection> m_wmconnections;
@@ -114,7 +136,8 @@ private:
     QString m_serviceName;
     QString m_menuObjectPath;
 
-    QPointer<KDBusMenuImporter> m_importer;
+    //! shared with the models of other applets that show the same menu
+    QSharedPointer<KDBusMenuImporter> m_importer;
 };
 
 #endif
@@ -21,15 +21,162 @@
 #include "commontools.h"
 
 // Qt
+#include <QCoreApplication>
+#include <QDir>
+#include <QEvent>
 #include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSet>
 #include <QStandardPaths>
 
-namespace AppletDecoration {
+// KDE
+#include <KConfigGroup>
+#include <KSharedConfig>
 
-QString standardPath(QString subPath, bool localfirst)
+namespace {
+//! Remembers the resolved standard paths and the color scheme of kdeglobals.
+//! Every value is forgotten when one of the paths it was resolved from changes.
+//! Lookups happen also from the SchemesLoader thread, so the resolver lives in
+//! the main thread, where its watcher is created and fed through posted events.
+class PathResolver : public QObject
 {
-    QStringList paths = QStandardPaths::standardLocations(QStandardPaths::GenericDataLocation);
+public:
+    PathResolver()
+    {
+        //! the first lookup may come from a worker thread
+        if (QCoreApplication::instance()) {
+            moveToThread(QCoreApplication::instance()->thread());
+        }
+    }
+
+    bool find(const QString &key, QString &value) const
+    {
+        QMutexLocker locker(&m_mutex);
+        auto it = m_values.constFind(key);
+
+        if (it == m_values.constEnd()) {
+            return false;
+        }
+
+        value = *it;
+        return true;
+    }
+
+    void insert(const QString &key, const QString &value, const QStringList &watchedPaths)
+    {
+        QMutexLocker locker(&m_mutex);
+        m_values[key] = value;
+
+        for (const auto &path : watchedPaths) {
+            m_dependents[path].insert(key);
+
+            if (!m_watchedPaths.contains(path) && !m_pendingPaths.contains(path)) {
+                m_pendingPaths << path;
+            }
+        }
+
+        if (!m_pendingPaths.isEmpty() && !m_watchRequested) {
+            m_watchRequested = true;
+            QCoreApplication::postEvent(this, new QEvent(QEvent::User));
+        }
+    }
+
+    QStringList dataLocations()
+    {
+        QMutexLocker locker(&m_mutex);
+
+        if (m_dataLocations.isEmpty()) {
+            m_dataLocations = QStandardPaths::standardLocations(QStandardPaths::GenericDataLocation);
+        }
+
+        return m_dataLocations;
+    }
+
+protected:
+    bool event(QEvent *e) override
+    {
+        if (e->type() != QEvent::User) {
+            return QObject::event(e);
+        }
+
+        if (!m_watcher) {
+            m_watcher = new QFileSystemWatcher(this);
+
+            connect(m_watcher, &QFileSystemWatcher::directoryChanged, this, &PathResolver::invalidate);
+            connect(m_watcher, &QFileSystemWatcher::fileChanged, this, [this](const QString &path) {
+                //! files that are replaced instead of rewritten drop out of the watcher
+                m_watcher->addPath(path);
+                invalidate(path);
+            });
+        }
+
+        QStringList paths;
+
+        {
+            QMutexLocker locker(&m_mutex);
+            paths = m_pendingPaths;
+            m_pendingPaths.clear();
+            m_watchRequested = false;
+
+            for (const auto &path : paths) {
+                m_watchedPaths << path;
+            }
+        }
+
+        if (!paths.isEmpty()) {
+            m_watcher->addPaths(paths);
+        }
+
+        return true;
+    }
+
+private:
+    //! e.g. a change of kdeglobals drops only its color scheme, the standard
+    //! paths that were resolved from other directories stay valid
+    void invalidate(const QString &path)
+    {
+        QMutexLocker locker(&m_mutex);
+        const QSet<QString> keys = m_dependents.take(path);
+
+        for (const auto &key : keys) {
+            m_values.remove(key);
+        }
+    }
 
+private:
+    bool m_watchRequested{false};
+
+    mutable QMutex m_mutex;
+    QHash<QString, QString> m_values;
+    //! watched path to the keys of the values resolved from it
+    QHash<QString, QSet<QString>> m_dependents;
+    QStringList m_dataLocations;
+    QStringList m_pendingPaths;
+    QStringList m_watchedPaths;
+
+    //! created and used only in the main thread
+    QFileSystemWatcher *m_watcher{nullptr};
+};
+
+Q_GLOBAL_STATIC(PathResolver, s_pathResolver)
+
+//! nearest existing directory that would change when path is created or removed
+QString watchableDirectory(const QString &path)
+{
+    QString dir = QFileInfo(path).absolutePath();
+
+    while (!dir.isEmpty() && !QFileInfo(dir).isDir() && dir != QLatin1String("/")) {
+        dir = QFileInfo(dir).absolutePath();
+    }
+
+    return dir;
+}
+
+QString resolveStandardPath(const QStringList &paths, const QString &subPath, bool localfirst)
+{
     if (localfirst) {
         for (const auto &pt : paths) {
             QString ptF = pt + "/" +subPath;
@@ -53,10 +200,71 @@ QString standardPath(QString subPath, bool localfirst)
 
     return "";
 }
+}
+
+namespace AppletDecoration {
+
+QString standardPath(QString subPath, bool localfirst)
+{
+    const QString key = (localfirst ? QStringLiteral("local:") : QStringLiteral("global:")) + subPath;
+    QString resolved;
+
+    if (s_pathResolver->find(key, resolved)) {
+        return resolved;
+    }
+
+    QStringList paths = s_pathResolver->dataLocations();
+    QStringList watchedPaths;
+
+    for (const auto &pt : paths) {
+        watchedPaths << watchableDirectory(pt + "/" + subPath);
+    }
+
+    watchedPaths << watchableDirectory("/usr/share/" + subPath);
+    watchedPaths.removeDuplicates();
+    watchedPaths.removeAll(QString());
+
+    resolved = resolveStandardPath(paths, subPath, localfirst);
+    s_pathResolver->insert(key, resolved, watchedPaths);
+
+    return resolved;
+}
+
+QString kdeglobalsColorScheme(QString defaultScheme)
+{
+    const QString key = QStringLiteral("kdeglobals:") + defaultScheme;
+    QString scheme;
+
+    if (s_pathResolver->find(key, scheme)) {
+        return scheme;
+    }
+
+    QString settingsFile = QDir::homePath() + "/.config/kdeglobals";
+
+    if (QFileInfo(settingsFile).exists()) {
+        KSharedConfigPtr filePtr = KSharedConfig::openConfig(settingsFile);
+        filePtr->reparseConfiguration();
+        KConfigGroup generalGroup = KConfigGroup(filePtr, "General");
+        scheme = generalGroup.readEntry("ColorScheme", "");
+        s_pathResolver->insert(key, scheme, {settingsFile});
+    } else {
+        //! wait for kdeglobals to be created
+        scheme = defaultScheme;
+        s_pathResolver->insert(key, scheme, {QFileInfo(settingsFile).absolutePath()});
+    }
+
+    return scheme;
+}
+
+void initPathCache()
+{
+    //! the global static is constructed on first use
+    s_pathResolver();
+}
 
 QStringList standardPaths(bool localfirst)
 {
-    QStringList paths = QStandardPaths::standardLocations(QStandardPaths::GenericDataLocation);
+    QStringList paths = s_pathResolver->dataLocations();
 
     if (localfirst) {
         return paths;
@@ -25,8 +25,17 @@ namespace AppletDecoration {
 
 //! returns the standard path found that contains the subPath
 //! local paths have higher priority by default
+//! results are cached until the standard directories change
 QString standardPath(QString subPath, bool localFirst = true);
 
+//! the ColorScheme of ~/.config/kdeglobals or defaultScheme when the file
+//! does not exist, cached until the file changes
+QString kdeglobalsColorScheme(QString defaultScheme);
+
+//! creates the cache of the functions above, it must be called from the main
+//! thread before any worker thread uses them
+void initPathCache();
+
 QStringList standardPaths(bool localfirst = true);
 QStringList standardPathsFor(QString subPath, bool localfirst = true);
 }
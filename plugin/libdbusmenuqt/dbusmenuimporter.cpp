@@ -11,12 +11,16 @@
 // Qt
 #include <QCoreApplication>
 #include <QDBusConnection>
+#include <QDBusConnectionInterface>
 #include <QDBusInterface>
+#include <QDBusMessage>
 #include <QDBusReply>
+#include <QDBusServiceWatcher>
 #include <QDBusVariant>
 #include <QDebug>
 #include <QFont>
 #include <QMenu>
+#include <QMultiHash>
 #include <QPointer>
 #include <QSet>
 #include <QTime>
@@ -25,6 +29,7 @@
 #include <QWidgetAction>
 
 // Local
+#include "dbusmenulayoutworker_p.h"
 #include "dbusmenushortcut_p.h"
 #include "dbusmenutypes_p.h"
 #include "utils_p.h"
@@ -32,6 +37,10 @@
 // Generated
 #include "dbusmenu_interface.h"
 
+// Instrumentation
+#include "../perf/latencystats.h"
+#include "../perf/tracer.h"
+
 //#define BENCHMARK
 #ifdef BENCHMARK
 static QTime sChrono;
@@ -47,6 +56,9 @@ static const char *DBUSMENU_PROPERTY_ID = "_dbusmenu_id";
 static const char *DBUSMENU_PROPERTY_ICON_NAME = "_dbusmenu_icon_name";
 static const char *DBUSMENU_PROPERTY_ICON_DATA_HASH = "_dbusmenu_icon_data_hash";
 
+// importers that are alive, replies of the layout worker are delivered only to them
+static QSet<QObject *> sLayoutRequesters;
+
 static QAction *createKdeTitle(QAction *action, QWidget *parent)
 {
     QToolButton *titleWidget = new QToolButton(nullptr);
@@ -77,14 +89,13 @@ public:
     QSet<int> m_idsRefreshedByAboutToShow;
     QSet<int> m_pendingLayoutUpdates;
 
-    QDBusPendingCallWatcher *refresh(int id)
+    void refresh(int id)
     {
-        auto call = m_interface->GetLayout(id, 1, QStringList());
-        QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(call, q);
-        watcher->setProperty(DBUSMENU_PROPERTY_ID, id);
-        QObject::connect(watcher, &QDBusPendingCallWatcher::finished, q, &DBusMenuImporter::slotGetLayoutFinished);
+        Perf::TraceSpan span("DBusMenuImporter::refresh");
 
-        return watcher;
+        DBusMenuLayoutWorker::self()->requestLayout(q, m_interface->service(), m_interface->path(), id);
+
+        Q_EMIT q->layoutRequested(id);
     }
 
     QMenu *createMenu(QWidget *parent)
@@ -258,6 +269,229 @@ public:
     }
 };
 
+/**
+ * Subscribes once per process to the com.canonical.dbusmenu signals of every
+ * sender and forwards them to the importers of the emitting service and path.
+ * The bus daemon then holds a single set of match rules, instead of one set
+ * per importer that is added and removed again on every focus change.
+ */
+class DBusMenuSignalDispatcher : public QObject
+{
+    Q_OBJECT
+public:
+    static DBusMenuSignalDispatcher *self()
+    {
+        static DBusMenuSignalDispatcher s_instance;
+        return &s_instance;
+    }
+
+    void subscribe(DBusMenuImporter *importer, const QString &service, const QString &path)
+    {
+        Subscriber subscriber;
+        subscriber.importer = importer;
+        subscriber.service = service;
+
+        if (service.startsWith(QLatin1Char(':'))) {
+            subscriber.owner = service;
+        } else if (m_serviceWatcher.watchedServices().contains(service)) {
+            subscriber.owner = ownerOf(service);
+        } else {
+            //! owner changes are followed, an application that restarts under the
+            //! same well-known name is then matched by its new unique name
+            m_serviceWatcher.addWatchedService(service);
+            resolveOwner(service);
+        }
+
+        m_subscribers.insert(path, subscriber);
+        Perf::LatencyStats::self()->increment(QStringLiteral("dbusMenuSubscriptions"));
+    }
+
+    void unsubscribe(DBusMenuImporter *importer, const QString &path)
+    {
+        QString service;
+        auto it = m_subscribers.find(path);
+
+        while (it != m_subscribers.end() && it.key() == path) {
+            if (it->importer == importer) {
+                service = it->service;
+                it = m_subscribers.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        if (!service.isEmpty() && m_serviceWatcher.watchedServices().contains(service) && !isSubscribed(service)) {
+            m_serviceWatcher.removeWatchedService(service);
+        }
+    }
+
+private Q_SLOTS:
+    void onLayoutUpdated(const QDBusMessage &message)
+    {
+        const QVariantList args = message.arguments();
+
+        if (args.count() < 2) {
+            return;
+        }
+
+        const uint revision = args.at(0).toUInt();
+        const int parentId = args.at(1).toInt();
+
+        for (DBusMenuImporter *importer : importersFor(message)) {
+            importer->slotLayoutUpdated(revision, parentId);
+        }
+    }
+
+    void onItemsPropertiesUpdated(const QDBusMessage &message)
+    {
+        const QVariantList args = message.arguments();
+
+        if (args.count() < 2) {
+            return;
+        }
+
+        const QList<DBusMenuImporter *> importers = importersFor(message);
+
+        if (importers.isEmpty()) {
+            return;
+        }
+
+        //! demarshalled once for all the importers of the same menu
+        const auto updatedList = qdbus_cast<DBusMenuItemList>(args.at(0));
+        const auto removedList = qdbus_cast<DBusMenuItemKeysList>(args.at(1));
+
+        for (DBusMenuImporter *importer : importers) {
+            importer->d->slotItemsPropertiesUpdated(updatedList, removedList);
+        }
+    }
+
+    void onItemActivationRequested(const QDBusMessage &message)
+    {
+        const QVariantList args = message.arguments();
+
+        if (args.count() < 2) {
+            return;
+        }
+
+        const int id = args.at(0).toInt();
+        const uint timestamp = args.at(1).toUInt();
+
+        for (DBusMenuImporter *importer : importersFor(message)) {
+            importer->slotItemActivationRequested(id, timestamp);
+        }
+    }
+
+    void onServiceOwnerChanged(const QString &service, const QString &oldOwner, const QString &newOwner)
+    {
+        Q_UNUSED(oldOwner)
+        setOwner(service, newOwner);
+    }
+
+private:
+    struct Subscriber {
+        DBusMenuImporter *importer{nullptr};
+        QString service;
+        //! unique connection name of service, empty until it is resolved
+        //! or while the service has no owner
+        QString owner;
+        //! signals arrived for the path while the owner was unknown
+        bool missedSignals{false};
+    };
+
+    DBusMenuSignalDispatcher()
+        : m_serviceWatcher(QString(), QDBusConnection::sessionBus(), QDBusServiceWatcher::WatchForOwnerChange)
+    {
+        connect(&m_serviceWatcher, &QDBusServiceWatcher::serviceOwnerChanged, this, &DBusMenuSignalDispatcher::onServiceOwnerChanged);
+
+        static const QString dbusMenuInterface = QStringLiteral("com.canonical.dbusmenu");
+        QDBusConnection bus = QDBusConnection::sessionBus();
+
+        //! empty service and path match every sender, the filtering happens in importersFor
+        bus.connect(QString(), QString(), dbusMenuInterface, QStringLiteral("LayoutUpdated"), this, SLOT(onLayoutUpdated(QDBusMessage)));
+        bus.connect(QString(), QString(), dbusMenuInterface, QStringLiteral("ItemsPropertiesUpdated"), this, SLOT(onItemsPropertiesUpdated(QDBusMessage)));
+        bus.connect(QString(), QString(), dbusMenuInterface, QStringLiteral("ItemActivationRequested"), this, SLOT(onItemActivationRequested(QDBusMessage)));
+    }
+
+    QList<DBusMenuImporter *> importersFor(const QDBusMessage &message)
+    {
+        QList<DBusMenuImporter *> importers;
+        const QString sender = message.service();
+
+        for (auto it = m_subscribers.find(message.path()); it != m_subscribers.end() && it.key() == message.path(); ++it) {
+            if (it->owner.isEmpty()) {
+                //! the signal may or may not be ours, the menu is refreshed once the owner is known
+                it->missedSignals = true;
+            } else if (it->owner == sender) {
+                importers << it->importer;
+            }
+        }
+
+        Perf::LatencyStats::self()->increment(importers.isEmpty() ? QStringLiteral("dbusMenuSignalsUnmatched")
+                                                                  : QStringLiteral("dbusMenuSignalsDispatched"));
+        return importers;
+    }
+
+    bool isSubscribed(const QString &service) const
+    {
+        for (const Subscriber &subscriber : m_subscribers) {
+            if (subscriber.service == service) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    QString ownerOf(const QString &service) const
+    {
+        for (const Subscriber &subscriber : m_subscribers) {
+            if (subscriber.service == service) {
+                return subscriber.owner;
+            }
+        }
+
+        return QString();
+    }
+
+    void setOwner(const QString &service, const QString &owner)
+    {
+        for (Subscriber &subscriber : m_subscribers) {
+            if (subscriber.service != service || subscriber.owner == owner) {
+                continue;
+            }
+
+            //! a restarted owner or lost signals, the layout has to be fetched again
+            const bool refresh = !owner.isEmpty() && (subscriber.missedSignals || !subscriber.owner.isEmpty());
+
+            subscriber.owner = owner;
+            subscriber.missedSignals = false;
+
+            if (refresh) {
+                subscriber.importer->slotLayoutUpdated(0, 0);
+            }
+        }
+    }
+
+    void resolveOwner(const QString &service)
+    {
+        QDBusPendingCall call = QDBusConnection::sessionBus().interface()->asyncCall(QStringLiteral("GetNameOwner"), service);
+        auto watcher = new QDBusPendingCallWatcher(call, this);
+
+        connect(watcher, &QDBusPendingCallWatcher::finished, this, [this, service](QDBusPendingCallWatcher *watcher) {
+            watcher->deleteLater();
+            QDBusPendingReply<QString> reply = *watcher;
+
+            //! without an owner nothing is matched until NameOwnerChanged names one
+            setOwner(service, reply.isError() ? QString() : reply.value());
+        });
+    }
+
+    QDBusServiceWatcher m_serviceWatcher;
+
+    //! object path -> importers of that path
+    QMultiHash<QString, Subscriber> m_subscribers;
+};
+
 DBusMenuImporter::DBusMenuImporter(const QString &service, const QString &path, QObject *parent)
     : QObject(parent)
     , d(new DBusMenuImporterPrivate)
@@ -272,14 +506,19 @@ DBusMenuImporter::DBusMenuImporter(const QString &service, const QString &path,
     d->m_pendingLayoutUpdateTimer->setSingleShot(true);
     connect(d->m_pendingLayoutUpdateTimer, &QTimer::timeout, this, &DBusMenuImporter::processPendingLayoutUpdates);
 
-    connect(d->m_interface, &DBusMenuInterface::LayoutUpdated, this, &DBusMenuImporter::slotLayoutUpdated);
-    connect(d->m_interface, &DBusMenuInterface::ItemActivationRequested, this, &DBusMenuImporter::slotItemActivationRequested);
-    connect(d->m_interface,
-            &DBusMenuInterface::ItemsPropertiesUpdated,
-            this,
-            [this](const DBusMenuItemList &updatedList, const DBusMenuItemKeysList &removedList) {
-                d->slotItemsPropertiesUpdated(updatedList, removedList);
-            });
+    //! the signals of m_interface are not connected on purpose, connecting them
+    //! would add this importer's own match rules to the bus daemon
+    DBusMenuSignalDispatcher::self()->subscribe(this, service, path);
+
+    // a single connection for all importers, so that a reply is not broadcast
+    // to every importer of the process
+    static bool sLayoutReadyConnected = false;
+    if (!sLayoutReadyConnected) {
+        sLayoutReadyConnected = true;
+        connect(DBusMenuLayoutWorker::self(), &DBusMenuLayoutWorker::layoutReady, QCoreApplication::instance(), &DBusMenuImporter::deliverLayoutChanges);
+    }
+
+    sLayoutRequesters.insert(this);
 
     d->refresh(0);
 }
@@ -289,6 +528,9 @@ DBusMenuImporter::~DBusMenuImporter()
     // Do not use "delete d->m_menu": even if we are being deleted we should
     // leave enough time for the menu to finish what it was doing, for example
     // if it was being displayed.
+    DBusMenuSignalDispatcher::self()->unsubscribe(this, d->m_interface->path());
+    sLayoutRequesters.remove(this);
+    DBusMenuLayoutWorker::self()->forget(this);
     d->m_menu->deleteLater();
     delete d;
 }
@@ -324,6 +566,8 @@ QMenu *DBusMenuImporter::menu() const
 
 void DBusMenuImporterPrivate::slotItemsPropertiesUpdated(const DBusMenuItemList &updatedList, const DBusMenuItemKeysList &removedList)
 {
+    Perf::TraceSpan span("DBusMenuImporter::slotItemsPropertiesUpdated");
+
     Q_FOREACH (const DBusMenuItem &item, updatedList) {
         QAction *action = m_actionForId.value(item.id);
         if (!action) {
@@ -348,6 +592,8 @@ void DBusMenuImporterPrivate::slotItemsPropertiesUpdated(const DBusMenuItemList
             updateActionProperty(action, key, QVariant());
         }
     }
+
+    DBusMenuLayoutWorker::self()->updateProperties(q, updatedList, removedList);
 }
 
 QAction *DBusMenuImporter::actionForId(int id) const
@@ -362,16 +608,24 @@ void DBusMenuImporter::slotItemActivationRequested(int id, uint /*timestamp*/)
     actionActivationRequested(action);
 }
 
-void DBusMenuImporter::slotGetLayoutFinished(QDBusPendingCallWatcher *watcher)
+void DBusMenuImporter::deliverLayoutChanges(QObject *requester, int parentId, const DBusMenuLayoutChanges &changes)
 {
-    int parentId = watcher->property(DBUSMENU_PROPERTY_ID).toInt();
-    watcher->deleteLater();
+    // the requester may have been destroyed while the reply was queued
+    if (sLayoutRequesters.contains(requester)) {
+        static_cast<DBusMenuImporter *>(requester)->applyLayoutChanges(parentId, changes);
+    }
+}
+
+void DBusMenuImporter::applyLayoutChanges(int parentId, const DBusMenuLayoutChanges &changes)
+{
+    Perf::TraceSpan span("DBusMenuImporter::applyLayoutChanges");
+
+    Q_EMIT layoutReceived(parentId);
 
     QMenu *menu = d->menuForId(parentId);
 
-    QDBusPendingReply<uint, DBusMenuLayoutItem> reply = *watcher;
-    if (!reply.isValid()) {
-        qDebug(DBUSMENUQT) << reply.error().message();
+    if (!changes.error.isEmpty()) {
+        qDebug(DBUSMENUQT) << changes.error;
         if (menu) {
             Q_EMIT menuUpdated(menu);
         }
@@ -381,40 +635,59 @@ void DBusMenuImporter::slotGetLayoutFinished(QDBusPendingCallWatcher *watcher)
 #ifdef BENCHMARK
     DMDEBUG << "- items received:" << sChrono.elapsed() << "ms";
 #endif
-    DBusMenuLayoutItem rootItem = reply.argumentAt<1>();
 
     if (!menu) {
         qDebug(DBUSMENUQT) << "No menu for id" << parentId;
+        DBusMenuLayoutWorker::self()->forget(this, parentId);
         return;
     }
 
-    // remove outdated actions
-    QSet<int> newDBusMenuItemIds;
-    newDBusMenuItemIds.reserve(rootItem.children.count());
-    for (const DBusMenuLayoutItem &item : qAsConst(rootItem.children)) {
-        newDBusMenuItemIds << item.id;
-    }
-    for (QAction *action : menu->actions()) {
-        int id = action->property(DBUSMENU_PROPERTY_ID).toInt();
-        if (!newDBusMenuItemIds.contains(id)) {
-            // Not calling removeAction() as QMenu will immediately close when it becomes empty,
-            // which can happen when an application completely reloads this menu.
-            // When the action is deleted deferred, it is removed from the menu.
-            action->deleteLater();
-            if (action->menu()) {
-                action->menu()->deleteLater();
+    QList<int> removedIds = changes.removedIds;
+
+    if (changes.complete) {
+        QSet<int> newDBusMenuItemIds;
+        newDBusMenuItemIds.reserve(changes.changes.count());
+        for (const DBusMenuLayoutChange &change : changes.changes) {
+            newDBusMenuItemIds << change.id;
+        }
+        for (QAction *action : menu->actions()) {
+            int id = action->property(DBUSMENU_PROPERTY_ID).toInt();
+            if (!newDBusMenuItemIds.contains(id)) {
+                removedIds << id;
             }
-            d->m_actionForId.remove(id);
         }
     }
 
-    // insert or update new actions into our menu
-    for (const DBusMenuLayoutItem &dbusMenuItem : qAsConst(rootItem.children)) {
-        DBusMenuImporterPrivate::ActionForId::Iterator it = d->m_actionForId.find(dbusMenuItem.id);
-        QAction *action = nullptr;
+    // remove outdated actions
+    for (int id : qAsConst(removedIds)) {
+        QAction *action = d->m_actionForId.take(id);
+        if (!action) {
+            continue;
+        }
+        // Not calling removeAction() as QMenu will immediately close when it becomes empty,
+        // which can happen when an application completely reloads this menu.
+        // When the action is deleted deferred, it is removed from the menu.
+        action->deleteLater();
+        if (action->menu()) {
+            action->menu()->deleteLater();
+        }
+    }
+
+    bool outOfSync = false;
+
+    // insert new actions into our menu or update the changed ones
+    for (const DBusMenuLayoutChange &change : changes.changes) {
+        DBusMenuImporterPrivate::ActionForId::Iterator it = d->m_actionForId.find(change.id);
+
         if (it == d->m_actionForId.end()) {
-            int id = dbusMenuItem.id;
-            action = d->createAction(id, dbusMenuItem.properties, menu);
+            if (!change.added) {
+                // the worker knows an action that is already gone
+                outOfSync = true;
+                continue;
+            }
+
+            int id = change.id;
+            QAction *action = d->createAction(id, change.properties, menu);
             d->m_actionForId.insert(id, action);
 
             connect(action, &QObject::destroyed, this, [this, id]() {
@@ -432,18 +705,33 @@ void DBusMenuImporter::slotGetLayoutFinished(QDBusPendingCallWatcher *watcher)
 
             menu->addAction(action);
         } else {
-            action = *it;
-            QStringList filteredKeys = dbusMenuItem.properties.keys();
+            QStringList filteredKeys = change.properties.keys() + change.resetProperties;
             filteredKeys.removeOne("type");
             filteredKeys.removeOne("toggle-type");
             filteredKeys.removeOne("children-display");
-            d->updateAction(*it, dbusMenuItem.properties, filteredKeys);
-            // Move the action to the tail so we can keep the order same as the dbus request.
+            d->updateAction(*it, change.properties, filteredKeys);
+
+            if (change.added) {
+                // the worker forgot this menu, so keep the order of the dbus request
+                menu->removeAction(*it);
+                menu->addAction(*it);
+            }
+        }
+    }
+
+    // Move the actions to the tail so we can keep the order same as the dbus request.
+    for (int id : changes.order) {
+        if (QAction *action = d->m_actionForId.value(id)) {
             menu->removeAction(action);
             menu->addAction(action);
         }
     }
 
+    if (outOfSync) {
+        DBusMenuLayoutWorker::self()->forget(this, parentId);
+        d->refresh(parentId);
+    }
+
     Q_EMIT menuUpdated(menu);
 }
 
@@ -534,3 +822,4 @@ QIcon DBusMenuImporter::iconForName(const QString & /*name*/)
 }
 
 #include "moc_dbusmenuimporter.cpp"
+#include "dbusmenuimporter.moc"
@@ -15,6 +15,7 @@ class QIcon;
 class QMenu;
 
 class DBusMenuImporterPrivate;
+struct DBusMenuLayoutChanges;
 
 /**
  * A DBusMenuImporter instance can recreate a menu serialized over DBus by
@@ -61,6 +62,16 @@ Q_SIGNALS:
      */
     void actionActivationRequested(QAction *);
 
+    /**
+     * Emitted when the layout of the menu with the given id is requested
+     */
+    void layoutRequested(int id);
+
+    /**
+     * Emitted when the reply for a requested layout has been received
+     */
+    void layoutReceived(int id);
+
 protected:
     /**
      * Must create a menu, may be customized to fit host appearance.
@@ -82,12 +93,15 @@ private Q_SLOTS:
     void slotItemActivationRequested(int id, uint timestamp);
     void processPendingLayoutUpdates();
     void slotLayoutUpdated(uint revision, int parentId);
-    void slotGetLayoutFinished(QDBusPendingCallWatcher *);
 
 private:
+    static void deliverLayoutChanges(QObject *requester, int parentId, const DBusMenuLayoutChanges &changes);
+    void applyLayoutChanges(int parentId, const DBusMenuLayoutChanges &changes);
+
     Q_DISABLE_COPY(DBusMenuImporter)
     DBusMenuImporterPrivate *const d;
     friend class DBusMenuImporterPrivate;
+    friend class DBusMenuSignalDispatcher;
 
     // Use Q_PRIVATE_SLOT to avoid exposing DBusMenuItemList
     Q_PRIVATE_SLOT(d, void slotItemsPropertiesUpdated(const DBusMenuItemList &updatedList, const DBusMenuItemKeysList &removedList))
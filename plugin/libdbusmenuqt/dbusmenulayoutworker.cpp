@@ -0,0 +1,295 @@
+/* This file is part of the dbusmenu-qt library
+    SPDX-FileCopyrightText: 2020 Michail Vourlakos <mvourlakos@gmail.com>
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+#include "dbusmenulayoutworker_p.h"
+
+// Qt
+#include <QCoreApplication>
+#include <QDBusMessage>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+#include <QSet>
+#include <QThread>
+
+// Instrumentation
+#include "../perf/tracer.h"
+
+static const char *WORKER_PROPERTY_REQUESTER = "_dbusmenu_requester";
+static const char *WORKER_PROPERTY_PARENT_ID = "_dbusmenu_parent_id";
+
+DBusMenuLayoutWorker *DBusMenuLayoutWorker::self()
+{
+    // the worker outlives its thread on purpose: importers that are destroyed
+    // after the application still call forget(), which is then never processed
+    static DBusMenuLayoutWorker *sWorker = nullptr;
+
+    if (!sWorker) {
+        DBusMenuTypes_register();
+        qRegisterMetaType<DBusMenuLayoutChanges>();
+
+        QThread *thread = new QThread;
+        thread->setObjectName(QStringLiteral("DBusMenuLayoutWorker"));
+
+        sWorker = new DBusMenuLayoutWorker;
+        sWorker->moveToThread(thread);
+        // finished is emitted in the worker thread, the bus is left there
+        connect(thread, &QThread::finished, sWorker, &DBusMenuLayoutWorker::onThreadFinished, Qt::DirectConnection);
+        thread->start();
+
+        // stopped while the application still exists, not from a static destructor
+        qAddPostRoutine([]() {
+            sWorker->thread()->quit();
+            sWorker->thread()->wait();
+        });
+    }
+
+    return sWorker;
+}
+
+DBusMenuLayoutWorker::DBusMenuLayoutWorker()
+    : QObject(nullptr)
+{
+    // posted from the gui thread, so they are queued into the worker thread
+    connect(this, &DBusMenuLayoutWorker::layoutRequestPosted, this, &DBusMenuLayoutWorker::onLayoutRequested);
+    connect(this, &DBusMenuLayoutWorker::forgetPosted, this, &DBusMenuLayoutWorker::onForget);
+    connect(this, &DBusMenuLayoutWorker::propertiesUpdatePosted, this, &DBusMenuLayoutWorker::onPropertiesUpdated);
+}
+
+void DBusMenuLayoutWorker::onThreadFinished()
+{
+    qDeleteAll(m_pendingCalls);
+    m_pendingCalls.clear();
+    m_mirrors.clear();
+
+    if (m_connected) {
+        m_connected = false;
+        QDBusConnection::disconnectFromBus(QStringLiteral("dbusmenu-layout-worker"));
+    }
+}
+
+QDBusConnection DBusMenuLayoutWorker::connection()
+{
+    m_connected = true;
+    return QDBusConnection::connectToBus(QDBusConnection::SessionBus, QStringLiteral("dbusmenu-layout-worker"));
+}
+
+void DBusMenuLayoutWorker::requestLayout(QObject *requester, const QString &service, const QString &path, int parentId)
+{
+    Q_EMIT layoutRequestPosted(requester, service, path, parentId);
+}
+
+void DBusMenuLayoutWorker::forget(QObject *requester, int parentId)
+{
+    Q_EMIT forgetPosted(requester, parentId);
+}
+
+void DBusMenuLayoutWorker::updateProperties(QObject *requester, const DBusMenuItemList &updatedList, const DBusMenuItemKeysList &removedList)
+{
+    Q_EMIT propertiesUpdatePosted(requester, updatedList, removedList);
+}
+
+void DBusMenuLayoutWorker::onLayoutRequested(QObject *requester, const QString &service, const QString &path, int parentId)
+{
+    QDBusMessage call = QDBusMessage::createMethodCall(service, path, QStringLiteral("com.canonical.dbusmenu"), QStringLiteral("GetLayout"));
+    call << parentId << 1 << QStringList();
+
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(connection().asyncCall(call), this);
+    watcher->setProperty(WORKER_PROPERTY_REQUESTER, QVariant::fromValue(requester));
+    watcher->setProperty(WORKER_PROPERTY_PARENT_ID, parentId);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, &DBusMenuLayoutWorker::onGetLayoutFinished);
+
+    m_pendingCalls.insert(requester, watcher);
+}
+
+void DBusMenuLayoutWorker::onForget(QObject *requester, int parentId)
+{
+    if (parentId >= 0) {
+        auto it = m_mirrors.find(requester);
+
+        if (it != m_mirrors.end()) {
+            forgetMenu(*it, parentId);
+        }
+
+        return;
+    }
+
+    m_mirrors.remove(requester);
+
+    // the requester is gone, its replies must not reach a new requester at the same address
+    for (QDBusPendingCallWatcher *watcher : m_pendingCalls.values(requester)) {
+        delete watcher;
+    }
+
+    m_pendingCalls.remove(requester);
+}
+
+void DBusMenuLayoutWorker::onPropertiesUpdated(QObject *requester, const DBusMenuItemList &updatedList, const DBusMenuItemKeysList &removedList)
+{
+    auto mirror = m_mirrors.find(requester);
+
+    if (mirror == m_mirrors.end()) {
+        return;
+    }
+
+    auto mirroredItem = [&mirror](int id) -> MirroredItem * {
+        auto parent = mirror->parents.constFind(id);
+
+        if (parent == mirror->parents.constEnd()) {
+            return nullptr;
+        }
+
+        auto menu = mirror->menus.find(*parent);
+
+        if (menu == mirror->menus.end()) {
+            return nullptr;
+        }
+
+        for (MirroredItem &item : *menu) {
+            if (item.id == id) {
+                return &item;
+            }
+        }
+
+        return nullptr;
+    };
+
+    for (const DBusMenuItem &item : updatedList) {
+        if (MirroredItem *mirrored = mirroredItem(item.id)) {
+            for (auto it = item.properties.constBegin(); it != item.properties.constEnd(); ++it) {
+                mirrored->properties.insert(it.key(), it.value());
+            }
+        }
+    }
+
+    for (const DBusMenuItemKeys &item : removedList) {
+        if (MirroredItem *mirrored = mirroredItem(item.id)) {
+            for (const QString &key : item.properties) {
+                mirrored->properties.remove(key);
+            }
+        }
+    }
+}
+
+void DBusMenuLayoutWorker::onGetLayoutFinished(QDBusPendingCallWatcher *watcher)
+{
+    Perf::TraceSpan span("DBusMenuLayoutWorker::onGetLayoutFinished");
+
+    QObject *requester = watcher->property(WORKER_PROPERTY_REQUESTER).value<QObject *>();
+    const int parentId = watcher->property(WORKER_PROPERTY_PARENT_ID).toInt();
+
+    m_pendingCalls.remove(requester, watcher);
+    watcher->deleteLater();
+
+    DBusMenuLayoutChanges changes;
+    QDBusPendingReply<uint, DBusMenuLayoutItem> reply = *watcher;
+
+    if (!reply.isValid()) {
+        changes.error = reply.error().message();
+    } else {
+        changes = diff(m_mirrors[requester], parentId, reply.argumentAt<1>());
+    }
+
+    Q_EMIT layoutReady(requester, parentId, changes);
+}
+
+DBusMenuLayoutChanges DBusMenuLayoutWorker::diff(Mirror &mirror, int parentId, const DBusMenuLayoutItem &rootItem)
+{
+    const MirroredMenu previous = mirror.menus.value(parentId);
+
+    QHash<int, int> previousIndex;
+    previousIndex.reserve(previous.count());
+
+    for (int i = 0; i < previous.count(); ++i) {
+        previousIndex.insert(previous.at(i).id, i);
+    }
+
+    DBusMenuLayoutChanges changes;
+    changes.complete = !mirror.menus.contains(parentId);
+
+    MirroredMenu current;
+    current.reserve(rootItem.children.count());
+
+    QSet<int> currentIds;
+    currentIds.reserve(rootItem.children.count());
+
+    QList<int> order;
+    QList<int> addedIds;
+
+    for (const DBusMenuLayoutItem &child : rootItem.children) {
+        currentIds << child.id;
+        order << child.id;
+        current << MirroredItem{child.id, child.properties};
+
+        auto it = previousIndex.constFind(child.id);
+
+        if (it == previousIndex.constEnd()) {
+            changes.changes << DBusMenuLayoutChange{child.id, true, child.properties, QStringList()};
+            addedIds << child.id;
+            continue;
+        }
+
+        const QVariantMap &previousProperties = previous.at(*it).properties;
+        DBusMenuLayoutChange change{child.id, false, QVariantMap(), QStringList()};
+
+        for (auto property = child.properties.constBegin(); property != child.properties.constEnd(); ++property) {
+            auto previousProperty = previousProperties.constFind(property.key());
+
+            if (previousProperty == previousProperties.constEnd() || *previousProperty != *property) {
+                change.properties.insert(property.key(), property.value());
+            }
+        }
+
+        for (auto property = previousProperties.constBegin(); property != previousProperties.constEnd(); ++property) {
+            if (!child.properties.contains(property.key())) {
+                change.resetProperties << property.key();
+            }
+        }
+
+        if (!change.properties.isEmpty() || !change.resetProperties.isEmpty()) {
+            changes.changes << change;
+        }
+    }
+
+    QList<int> appendedOrder;
+
+    for (const MirroredItem &item : previous) {
+        if (currentIds.contains(item.id)) {
+            appendedOrder << item.id;
+        } else {
+            changes.removedIds << item.id;
+        }
+    }
+
+    appendedOrder << addedIds;
+
+    if (appendedOrder != order) {
+        changes.order = order;
+    }
+
+    // removed and added items drop their submenus, the importer creates new ones for them
+    for (int id : qAsConst(changes.removedIds)) {
+        mirror.parents.remove(id);
+        forgetMenu(mirror, id);
+    }
+
+    for (int id : qAsConst(addedIds)) {
+        mirror.parents.insert(id, parentId);
+        forgetMenu(mirror, id);
+    }
+
+    mirror.menus.insert(parentId, current);
+
+    return changes;
+}
+
+void DBusMenuLayoutWorker::forgetMenu(Mirror &mirror, int parentId)
+{
+    const MirroredMenu menu = mirror.menus.take(parentId);
+
+    for (const MirroredItem &item : menu) {
+        mirror.parents.remove(item.id);
+        forgetMenu(mirror, item.id);
+    }
+}
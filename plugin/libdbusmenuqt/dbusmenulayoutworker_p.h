@@ -0,0 +1,123 @@
+/* This file is part of the dbusmenu-qt library
+    SPDX-FileCopyrightText: 2020 Michail Vourlakos <mvourlakos@gmail.com>
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+#pragma once
+
+// Qt
+#include <QDBusConnection>
+#include <QHash>
+#include <QMultiHash>
+#include <QObject>
+
+// Local
+#include "dbusmenutypes_p.h"
+
+class QDBusPendingCallWatcher;
+
+/**
+ * A single item of a layout that was added or whose properties changed
+ */
+struct DBusMenuLayoutChange {
+    int id;
+    bool added;
+    // all the properties of added items, only the modified ones otherwise
+    QVariantMap properties;
+    // properties an existing item lost, they must return to their defaults
+    QStringList resetProperties;
+};
+
+/**
+ * The difference between a GetLayout() reply and the layout the importer
+ * applied previously for the same parent
+ */
+struct DBusMenuLayoutChanges {
+    QString error;
+    // nothing was mirrored for the parent, so every child is listed as added
+    // and any other action of the menu is outdated
+    bool complete{false};
+    QList<int> removedIds;
+    QList<DBusMenuLayoutChange> changes;
+    // complete order of the children, empty when appending the added items
+    // to the remaining ones already gives the right order
+    QList<int> order;
+};
+
+Q_DECLARE_METATYPE(DBusMenuLayoutChanges)
+
+/**
+ * Calls GetLayout() on a private bus connection and demarshals its replies
+ * in a worker thread. Every importer is mirrored with the properties it was
+ * given, so only the differences have to be applied in the gui thread.
+ *
+ * The public methods are meant to be called from the gui thread.
+ */
+class DBusMenuLayoutWorker : public QObject
+{
+    Q_OBJECT
+public:
+    static DBusMenuLayoutWorker *self();
+
+    /**
+     * The result is delivered through layoutReady()
+     */
+    void requestLayout(QObject *requester, const QString &service, const QString &path, int parentId);
+
+    /**
+     * Drops the mirrored layout of parentId, or of all the menus of the
+     * requester when parentId is -1
+     */
+    void forget(QObject *requester, int parentId = -1);
+
+    /**
+     * Keeps the mirror in sync with ItemsPropertiesUpdated() signals
+     */
+    void updateProperties(QObject *requester, const DBusMenuItemList &updatedList, const DBusMenuItemKeysList &removedList);
+
+Q_SIGNALS:
+    /**
+     * Emitted in the worker thread, it is meant to have a single receiver
+     * in the gui thread that routes the changes to the requester
+     */
+    void layoutReady(QObject *requester, int parentId, const DBusMenuLayoutChanges &changes);
+
+    // carry the requests of the gui thread to the worker thread
+    void layoutRequestPosted(QObject *requester, const QString &service, const QString &path, int parentId);
+    void forgetPosted(QObject *requester, int parentId);
+    void propertiesUpdatePosted(QObject *requester, const DBusMenuItemList &updatedList, const DBusMenuItemKeysList &removedList);
+
+private Q_SLOTS:
+    void onLayoutRequested(QObject *requester, const QString &service, const QString &path, int parentId);
+    void onForget(QObject *requester, int parentId);
+    void onPropertiesUpdated(QObject *requester, const DBusMenuItemList &updatedList, const DBusMenuItemKeysList &removedList);
+    void onGetLayoutFinished(QDBusPendingCallWatcher *watcher);
+    void onThreadFinished();
+
+private:
+    DBusMenuLayoutWorker();
+
+    struct MirroredItem {
+        int id;
+        QVariantMap properties;
+    };
+
+    using MirroredMenu = QList<MirroredItem>;
+
+    struct Mirror {
+        // parent id -> children as the importer applied them
+        QHash<int, MirroredMenu> menus;
+        // child id -> parent id
+        QHash<int, int> parents;
+    };
+
+    QDBusConnection connection();
+
+    DBusMenuLayoutChanges diff(Mirror &mirror, int parentId, const DBusMenuLayoutItem &rootItem);
+    void forgetMenu(Mirror &mirror, int parentId);
+
+    bool m_connected{false};
+
+    QHash<QObject *, Mirror> m_mirrors;
+    QMultiHash<QObject *, QDBusPendingCallWatcher *> m_pendingCalls;
+};
@@ -0,0 +1,206 @@
+/*
+*  Copyright 2020 Michail Vourlakos <mvourlakos@gmail.com>
+*
+*  This file is part of Latte-Dock
+*
+*  Latte-Dock is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU General Public License as
+*  published by the Free Software Foundation; either version 2 of
+*  the License, or (at your option) any later version.
+*
+*  Latte-Dock is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "latencystats.h"
+
+//C++
+#include <cmath>
+
+namespace Perf {
+
+LatencyStats::LatencyStats(QObject *parent)
+    : QObject(parent)
+{
+    m_clock.start();
+}
+
+LatencyStats *LatencyStats::self()
+{
+    static LatencyStats s_instance;
+    return &s_instance;
+}
+
+QString LatencyStats::stageName(int stage)
+{
+    switch (stage) {
+        case ActiveWindowChanged:
+            return QStringLiteral("total");
+        case ApplicationMenuChanged:
+            return QStringLiteral("applicationMenuChanged");
+        case LayoutRequested:
+            return QStringLiteral("layoutRequested");
+        case LayoutReceived:
+            return QStringLiteral("layoutReceived");
+        case MenuUpdated:
+            return QStringLiteral("menuUpdated");
+        case ModelUpdated:
+            return QStringLiteral("modelUpdated");
+        default:
+            return QString();
+    }
+}
+
+void LatencyStats::mark(const QObject *owner, Stage stage)
+{
+    const qint64 now = m_clock.nsecsElapsed();
+
+    if (stage == ActiveWindowChanged) {
+        Marks marks;
+        marks.fill(-1);
+        marks[ActiveWindowChanged] = now;
+        m_marks[owner] = marks;
+        return;
+    }
+
+    auto it = m_marks.find(owner);
+
+    if (it == m_marks.end() || it->at(stage) >= 0) {
+        //! not part of a focus change or this stage was already reached
+        return;
+    }
+
+    Marks &marks = *it;
+    marks[stage] = now;
+
+    //! some stages are skipped e.g. when the menu layout is already known
+    for (int previous = stage - 1; previous >= ActiveWindowChanged; --previous) {
+        if (marks[previous] >= 0) {
+            m_histograms[stage].add((now - marks[previous]) / 1000);
+            break;
+        }
+    }
+
+    if (stage == ModelUpdated) {
+        m_histograms[ActiveWindowChanged].add((now - marks[ActiveWindowChanged]) / 1000);
+        m_marks.erase(it);
+    }
+}
+
+void LatencyStats::release(const QObject *owner)
+{
+    m_marks.remove(owner);
+}
+
+void LatencyStats::addSample(const QString &name, qint64 usecs)
+{
+    m_samples[name].add(usecs);
+}
+
+void LatencyStats::increment(const QString &counter)
+{
+    ++m_counters[counter];
+}
+
+QStringList LatencyStats::stages() const
+{
+    QStringList names;
+
+    for (int i = 0; i < StagesCount; ++i) {
+        names << stageName(i);
+    }
+
+    names << m_samples.keys();
+
+    return names;
+}
+
+QVariantMap LatencyStats::statistics() const
+{
+    QVariantMap result;
+
+    for (int i = 0; i < StagesCount; ++i) {
+        result[stageName(i)] = m_histograms[i].toVariantMap();
+    }
+
+    for (auto it = m_samples.constBegin(); it != m_samples.constEnd(); ++it) {
+        result[it.key()] = it.value().toVariantMap();
+    }
+
+    return result;
+}
+
+QVariantMap LatencyStats::counters() const
+{
+    QVariantMap result;
+
+    for (auto it = m_counters.constBegin(); it != m_counters.constEnd(); ++it) {
+        result[it.key()] = it.value();
+    }
+
+    return result;
+}
+
+void LatencyStats::reset()
+{
+    m_marks.clear();
+    m_histograms = std::array<Histogram, StagesCount>();
+    m_samples.clear();
+    m_counters.clear();
+}
+
+qint64 LatencyStats::Histogram::upperBound(int bucket)
+{
+    return qRound64(16 * std::pow(2.0, bucket / 4.0));
+}
+
+void LatencyStats::Histogram::add(qint64 usecs)
+{
+    int bucket{0};
+
+    if (usecs > 16) {
+        bucket = qMin(BucketsCount - 1, static_cast<int>(std::ceil(4 * std::log2(usecs / 16.0))));
+    }
+
+    ++m_buckets[bucket];
+    ++m_count;
+    m_max = qMax(m_max, usecs);
+}
+
+qint64 LatencyStats::Histogram::percentile(qreal p) const
+{
+    if (m_count == 0) {
+        return 0;
+    }
+
+    const quint64 rank = qMax<quint64>(1, static_cast<quint64>(std::ceil(p * m_count)));
+    quint64 accumulated{0};
+
+    for (int i = 0; i < BucketsCount; ++i) {
+        accumulated += m_buckets[i];
+
+        if (accumulated >= rank) {
+            return qMin(upperBound(i), m_max);
+        }
+    }
+
+    return m_max;
+}
+
+QVariantMap LatencyStats::Histogram::toVariantMap() const
+{
+    QVariantMap map;
+    map[QStringLiteral("count")] = m_count;
+    map[QStringLiteral("p50")] = percentile(0.50);
+    map[QStringLiteral("p95")] = percentile(0.95);
+    map[QStringLiteral("p99")] = percentile(0.99);
+    map[QStringLiteral("max")] = m_max;
+    return map;
+}
+
+}
@@ -0,0 +1,112 @@
+/*
+*  Copyright 2020 Michail Vourlakos <mvourlakos@gmail.com>
+*
+*  This file is part of Latte-Dock
+*
+*  Latte-Dock is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU General Public License as
+*  published by the Free Software Foundation; either version 2 of
+*  the License, or (at your option) any later version.
+*
+*  Latte-Dock is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LATENCYSTATS_H
+#define LATENCYSTATS_H
+
+//Qt
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QStringList>
+#include <QVariantMap>
+
+//C++
+#include <array>
+
+namespace Perf {
+
+//! Collects the time spent between the stages that bring a newly focused
+//! window's menu into the menubar. Every stage is measured from the previous
+//! stage that was reached for the same owner (the AppMenuModel), so several
+//! applets can be tracked in parallel. It is exported over the session bus
+//! by the applet under org.kde.kappmenuview
+class LatencyStats : public QObject
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.kde.kappmenuview.LatencyStats")
+
+public:
+    enum Stage
+    {
+        ActiveWindowChanged = 0,
+        ApplicationMenuChanged,
+        LayoutRequested,
+        LayoutReceived,
+        MenuUpdated,
+        ModelUpdated,
+        StagesCount
+    };
+
+    static LatencyStats *self();
+
+    void mark(const QObject *owner, Stage stage);
+    //! forget any pending measurement of owner
+    void release(const QObject *owner);
+
+    //! used from binaries that measure on their own e.g. the applet for menus opening
+    Q_INVOKABLE void addSample(const QString &name, qint64 usecs);
+    //! counts occurrences of events that are not measured e.g. absorbed notifications
+    void increment(const QString &counter);
+
+public slots:
+    Q_SCRIPTABLE QStringList stages() const;
+    //! stage name -> {count, p50, p95, p99, max}, values are in microseconds
+    Q_SCRIPTABLE QVariantMap statistics() const;
+    //! counter name -> occurrences
+    Q_SCRIPTABLE QVariantMap counters() const;
+    Q_SCRIPTABLE void reset();
+
+private:
+    explicit LatencyStats(QObject *parent = nullptr);
+
+    static QString stageName(int stage);
+
+private:
+    //! quarter-octave buckets starting at 16us, the last one ends at ~16s
+    class Histogram
+    {
+    public:
+        void add(qint64 usecs);
+        qint64 percentile(qreal p) const;
+        QVariantMap toVariantMap() const;
+
+    private:
+        static const int BucketsCount = 80;
+        static qint64 upperBound(int bucket);
+
+        quint64 m_count{0};
+        qint64 m_max{0};
+        std::array<quint64, BucketsCount> m_buckets{};
+    };
+
+    using Marks = std::array<qint64, StagesCount>;
+
+    QElapsedTimer m_clock;
+    QHash<const QObject *, Marks> m_marks;
+
+    //! index 0 holds the total focus change to model update latency
+    std::array<Histogram, StagesCount> m_histograms;
+    QHash<QString, Histogram> m_samples;
+    QHash<QString, quint64> m_counters;
+};
+
+}
+
+#endif
@@ -0,0 +1,228 @@
+/*
+*  Copyright 2020 Michail Vourlakos <mvourlakos@gmail.com>
+*
+*  This file is part of Latte-Dock
+*
+*  Latte-Dock is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU General Public License as
+*  published by the Free Software Foundation; either version 2 of
+*  the License, or (at your option) any later version.
+*
+*  Latte-Dock is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "tracer.h"
+
+//Qt
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QDBusError>
+#include <QFileInfo>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThread>
+
+//C++
+#include <chrono>
+
+namespace Perf {
+
+std::atomic<bool> Tracer::s_enabled{qEnvironmentVariableIsSet("APPMENU_TRACE")};
+
+Tracer::Tracer(QObject *parent)
+    : QObject(parent)
+{
+    if (isEnabled()) {
+        m_events.store(new Event[Capacity]);
+    }
+}
+
+Tracer::~Tracer()
+{
+    s_enabled.store(false);
+    delete[] m_events.load();
+}
+
+Tracer *Tracer::self()
+{
+    static Tracer s_instance;
+    return &s_instance;
+}
+
+qint64 Tracer::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool Tracer::enabled() const
+{
+    return isEnabled();
+}
+
+Tracer::Event *Tracer::events() const
+{
+    return m_events.load(std::memory_order_acquire);
+}
+
+void Tracer::setEnabled(bool enabled)
+{
+    if (enabled && !events()) {
+        m_events.store(new Event[Capacity], std::memory_order_release);
+    }
+
+    if (s_enabled.exchange(enabled, std::memory_order_acq_rel) != enabled) {
+        emit enabledChanged(enabled);
+    }
+}
+
+void Tracer::record(const char *name, qint64 begin, qint64 duration)
+{
+    Event *events = this->events();
+
+    if (!events) {
+        return;
+    }
+
+    //! writers never wait for each other, a slot is only marked as valid
+    //! after all of its fields have been written
+    const quint64 index = m_head.fetch_add(1, std::memory_order_relaxed);
+    Event &event = events[index % Capacity];
+
+    event.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    event.name.store(name, std::memory_order_relaxed);
+    event.begin.store(begin, std::memory_order_relaxed);
+    event.duration.store(duration, std::memory_order_relaxed);
+    event.thread.store(reinterpret_cast<quintptr>(QThread::currentThreadId()), std::memory_order_relaxed);
+
+    event.sequence.store(index + 1, std::memory_order_release);
+}
+
+void Tracer::addSpan(const QString &name, qint64 begin, qint64 duration)
+{
+    if (isEnabled()) {
+        record(internedName(name), begin, duration);
+    }
+}
+
+const char *Tracer::internedName(const QString &name)
+{
+    static QMutex s_mutex;
+    static QHash<QString, QByteArray> s_names;
+
+    QMutexLocker locker(&s_mutex);
+    auto it = s_names.find(name);
+
+    if (it == s_names.end()) {
+        it = s_names.insert(name, name.toUtf8());
+    }
+
+    return it->constData();
+}
+
+void Tracer::clear()
+{
+    //! the slots are left to the writers, a new generation only hides the older spans
+    m_generationStart.store(m_head.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+QString Tracer::dumpFailed(const QString &message)
+{
+    if (calledFromDBus()) {
+        sendErrorReply(QDBusError::Failed, message);
+    } else {
+        qWarning() << "Tracer:" << message;
+    }
+
+    return QString();
+}
+
+QString Tracer::dump(const QString &fileName)
+{
+    const qint64 pid = QCoreApplication::applicationPid();
+
+    //! callers over D-Bus can only choose a file name, never a directory
+    const QString name = !fileName.isEmpty() ? fileName : QStringLiteral("windowappmenu-%1.json").arg(pid);
+
+    if (QFileInfo(name).fileName() != name || name == QLatin1String("..") || name == QLatin1String(".")) {
+        return dumpFailed(QStringLiteral("%1 is not a plain file name").arg(fileName));
+    }
+
+    const QString dirPath = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + QStringLiteral("/traces");
+
+    if (!QDir().mkpath(dirPath)) {
+        return dumpFailed(QStringLiteral("unable to create %1").arg(dirPath));
+    }
+
+    Event *events = this->events();
+    const quint64 head = m_head.load(std::memory_order_acquire);
+    const quint64 generationStart = m_generationStart.load(std::memory_order_acquire);
+    const quint64 first = qMax(generationStart, head > Capacity ? head - Capacity : 0);
+
+    QJsonArray traceEvents;
+
+    for (quint64 i = first; events && i < head; ++i) {
+        const Event &event = events[i % Capacity];
+        const quint64 sequence = event.sequence.load(std::memory_order_acquire);
+
+        if (sequence != i + 1) {
+            //! overwritten or still being written
+            continue;
+        }
+
+        const char *name = event.name.load(std::memory_order_relaxed);
+        const qint64 begin = event.begin.load(std::memory_order_relaxed);
+        const qint64 duration = event.duration.load(std::memory_order_relaxed);
+        const quintptr thread = event.thread.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if (event.sequence.load(std::memory_order_relaxed) != sequence) {
+            continue;
+        }
+
+        QJsonObject traceEvent;
+        traceEvent[QStringLiteral("name")] = QString::fromUtf8(name);
+        traceEvent[QStringLiteral("cat")] = QStringLiteral("appmenu");
+        traceEvent[QStringLiteral("ph")] = QStringLiteral("X");
+        traceEvent[QStringLiteral("ts")] = begin / 1000.0;
+        traceEvent[QStringLiteral("dur")] = duration / 1000.0;
+        traceEvent[QStringLiteral("pid")] = pid;
+        traceEvent[QStringLiteral("tid")] = static_cast<qint64>(thread);
+        traceEvents.append(traceEvent);
+    }
+
+    QJsonObject trace;
+    trace[QStringLiteral("traceEvents")] = traceEvents;
+    trace[QStringLiteral("displayTimeUnit")] = QStringLiteral("ms");
+
+    const QString path = dirPath + QLatin1Char('/') + name;
+    QSaveFile file(path);
+
+    if (!file.open(QIODevice::WriteOnly)) {
+        return dumpFailed(QStringLiteral("unable to write %1: %2").arg(path, file.errorString()));
+    }
+
+    file.write(QJsonDocument(trace).toJson(QJsonDocument::Compact));
+
+    if (!file.commit()) {
+        return dumpFailed(QStringLiteral("unable to write %1: %2").arg(path, file.errorString()));
+    }
+
+    return path;
+}
+
+}
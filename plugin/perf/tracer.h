@@ -0,0 +1,131 @@
+/*
+*  Copyright 2020 Michail Vourlakos <mvourlakos@gmail.com>
+*
+*  This file is part of Latte-Dock
+*
+*  Latte-Dock is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU General Public License as
+*  published by the Free Software Foundation; either version 2 of
+*  the License, or (at your option) any later version.
+*
+*  Latte-Dock is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRACER_H
+#define TRACER_H
+
+//Qt
+#include <QDBusContext>
+#include <QObject>
+#include <QString>
+
+//C++
+#include <atomic>
+
+namespace Perf {
+
+//! Records spans into a fixed size ring buffer that can be dumped in
+//! Chrome/Perfetto trace event format. It is disabled by default and can be
+//! enabled through APPMENU_TRACE environment variable or over D-Bus at
+//! /Tracer under org.kde.kappmenuview. While disabled, recording a span
+//! costs a single relaxed atomic load.
+class Tracer : public QObject, protected QDBusContext
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.kde.kappmenuview.Tracer")
+
+    Q_PROPERTY(bool enabled READ enabled WRITE setEnabled NOTIFY enabledChanged)
+
+public:
+    static Tracer *self();
+
+    static bool isEnabled() {
+        return s_enabled.load(std::memory_order_relaxed);
+    }
+
+    //! monotonic nanoseconds, shared by all binaries of the process
+    static qint64 now();
+
+    //! name must outlive the tracer, e.g. a string literal
+    void record(const char *name, qint64 begin, qint64 duration);
+
+    bool enabled() const;
+
+public slots:
+    Q_SCRIPTABLE void setEnabled(bool enabled);
+
+    //! writes the recorded spans to fileName inside the traces directory of the
+    //! application data location, a default name is used when fileName is empty.
+    //! Returns the file written, failures are replied as D-Bus errors
+    Q_SCRIPTABLE QString dump(const QString &fileName);
+    //! spans recorded so far are no longer dumped
+    Q_SCRIPTABLE void clear();
+
+    //! used from binaries that can not link against the tracer e.g. the applet
+    Q_INVOKABLE void addSpan(const QString &name, qint64 begin, qint64 duration);
+
+signals:
+    void enabledChanged(bool enabled);
+
+private:
+    explicit Tracer(QObject *parent = nullptr);
+    ~Tracer() override;
+
+    const char *internedName(const QString &name);
+    QString dumpFailed(const QString &message);
+
+private:
+    static const quint64 Capacity = 16384;
+
+    //! a seqlock slot, the fields are atomics too because readers may load
+    //! them while a writer stores a newer span into the same slot
+    struct Event {
+        std::atomic<quint64> sequence{0};
+        std::atomic<const char *> name{nullptr};
+        std::atomic<qint64> begin{0};
+        std::atomic<qint64> duration{0};
+        std::atomic<quintptr> thread{0};
+    };
+
+    Event *events() const;
+
+    static std::atomic<bool> s_enabled;
+
+    std::atomic<quint64> m_head{0};
+    //! spans with a lower index belong to a previous generation, see clear()
+    std::atomic<quint64> m_generationStart{0};
+    //! allocated once when tracing is enabled for the first time and never replaced,
+    //! writers may still use it while tracing is being disabled
+    std::atomic<Event *> m_events{nullptr};
+};
+
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char *name)
+        : m_name(Tracer::isEnabled() ? name : nullptr),
+          m_begin(m_name ? Tracer::now() : 0) {
+    }
+
+    ~TraceSpan() {
+        if (m_name) {
+            Tracer::self()->record(m_name, m_begin, Tracer::now() - m_begin);
+        }
+    }
+
+private:
+    Q_DISABLE_COPY(TraceSpan)
+
+    const char *m_name;
+    qint64 m_begin;
+};
+
+}
+
+#endif
@@ -21,15 +21,147 @@
 #include "schemecolors.h"
 
 #include "commontools.h"
+#include "schemescache.h"
 
 #include <QDebug>
-#include <QDir>
 #include <QFileInfo>
+#include <QMultiHash>
 
 #include <KConfigGroup>
 #include <KDirWatch>
 #include <KSharedConfig>
 
+//! SchemesModel creates a SchemeColors for every installed scheme, so instead of
+//! connecting all of them to KDirWatch::dirty a single connection routes the
+//! changes only to the schemes that track the changed file
+class SchemeColorsWatcher : public QObject
+{
+public:
+    SchemeColorsWatcher()
+    {
+        connect(KDirWatch::self(), &KDirWatch::dirty, this, &SchemeColorsWatcher::onDirty);
+    }
+
+    void addScheme(SchemeColors *scheme)
+    {
+        if (!m_schemes.contains(scheme->schemeFile())) {
+            KDirWatch::self()->addFile(scheme->schemeFile());
+        }
+
+        m_schemes.insert(scheme->schemeFile(), scheme);
+    }
+
+    void removeScheme(SchemeColors *scheme)
+    {
+        if (m_schemes.remove(scheme->schemeFile(), scheme) > 0 && !m_schemes.contains(scheme->schemeFile())) {
+            KDirWatch::self()->removeFile(scheme->schemeFile());
+        }
+    }
+
+private:
+    void onDirty(const QString &path)
+    {
+        const auto schemes = m_schemes.values(path);
+
+        for (auto scheme : schemes) {
+            scheme->updateScheme();
+        }
+    }
+
+private:
+    QMultiHash<QString, SchemeColors *> m_schemes;
+};
+
+Q_GLOBAL_STATIC(SchemeColorsWatcher, s_schemeColorsWatcher)
+
+namespace {
+//! order of the colors stored in SchemesCache entries
+enum SchemeColorIndex {
+    ActiveBackgroundColor = 0,
+    ActiveTextColor,
+    InactiveBackgroundColor,
+    InactiveTextColor,
+    HighlightColor,
+    HighlightedTextColor,
+    PositiveColor,
+    NeutralText,
+    NegativeText,
+    ButtonTextColor,
+    ButtonBackgroundColor,
+    ButtonHoverColor,
+    ButtonFocusColor,
+    SchemeColorsCount
+};
+
+SchemesCache::Entry parseSchemeFile(const QString &file)
+{
+    SchemesCache::Entry entry;
+
+    QString fileNameNoExt = file;
+
+    int lastSlash = file.lastIndexOf("/");
+
+    if (lastSlash >= 0) {
+        fileNameNoExt.remove(0, lastSlash + 1);
+    }
+
+    if (fileNameNoExt.endsWith(".colors")) {
+        fileNameNoExt.remove(".colors");
+    }
+
+    KSharedConfigPtr filePtr = KSharedConfig::openConfig(file);
+    KConfigGroup generalGroup = KConfigGroup(filePtr, "General");
+    KConfigGroup selGroup = KConfigGroup(filePtr, "Colors:Selection");
+    KConfigGroup windowGroup = KConfigGroup(filePtr, "Colors:Window");
+    KConfigGroup buttonGroup = KConfigGroup(filePtr, "Colors:Button");
+
+    entry.name = generalGroup.readEntry("Name", fileNameNoExt);
+
+    entry.colors.resize(SchemeColorsCount);
+    entry.colors[ActiveBackgroundColor] = windowGroup.readEntry("BackgroundNormal", QColor());
+    entry.colors[ActiveTextColor] = windowGroup.readEntry("ForegroundNormal", QColor());
+    entry.colors[InactiveBackgroundColor] = windowGroup.readEntry("BackgroundAlternate", QColor());
+    entry.colors[InactiveTextColor] = windowGroup.readEntry("ForegroundInactive", QColor());
+
+    entry.colors[HighlightColor] = selGroup.readEntry("BackgroundNormal", QColor());
+    entry.colors[HighlightedTextColor] = selGroup.readEntry("ForegroundNormal", QColor());
+
+    entry.colors[PositiveColor] = selGroup.readEntry("ForegroundPositive", QColor());
+    entry.colors[NeutralText] = selGroup.readEntry("ForegroundNeutral", QColor());
+    entry.colors[NegativeText] = selGroup.readEntry("ForegroundNegative", QColor());
+
+    entry.colors[ButtonTextColor] = buttonGroup.readEntry("ForegroundNormal", QColor());
+    entry.colors[ButtonBackgroundColor] = buttonGroup.readEntry("BackgroundNormal", QColor());
+    entry.colors[ButtonHoverColor] = buttonGroup.readEntry("DecorationHover", QColor());
+    entry.colors[ButtonFocusColor] = buttonGroup.readEntry("DecorationFocus", QColor());
+
+    return entry;
+}
+
+//! the scheme file is parsed only when it is not cached or it has changed since
+SchemesCache::Entry schemeEntry(const QString &file)
+{
+    SchemesCache::Entry entry;
+
+    if (!SchemesCache::self()->find(file, entry) || entry.colors.count() != SchemeColorsCount) {
+        SchemesCache::Entry stamped;
+        const bool exists = SchemesCache::stamp(file, stamped);
+
+        entry = parseSchemeFile(file);
+
+        if (exists) {
+            entry.inode = stamped.inode;
+            entry.size = stamped.size;
+            entry.modified = stamped.modified;
+            entry.changed = stamped.changed;
+            SchemesCache::self()->insert(file, entry);
+        }
+    }
+
+    return entry;
+}
+}
+
 
 SchemeColors::SchemeColors(QObject *parent, QString scheme, bool plasmaTheme) :
     QObject(parent),
@@ -42,13 +174,7 @@ SchemeColors::SchemeColors(QObject *parent, QString scheme, bool plasmaTheme) :
         m_schemeName = schemeName(pSchemeFile);
 
         //! track scheme file for changes
-        KDirWatch::self()->addFile(m_schemeFile);
-
-        connect(KDirWatch::self(), &KDirWatch::dirty, this, [ & ](const QString & path) {
-            if (path == m_schemeFile) {
-                updateScheme();
-            }
-        });
+        s_schemeColorsWatcher->addScheme(this);
     }
 
     updateScheme();
@@ -56,6 +182,9 @@ SchemeColors::SchemeColors(QObject *parent, QString scheme, bool plasmaTheme) :
 
 SchemeColors::~SchemeColors()
 {
+    if (!s_schemeColorsWatcher.isDestroyed()) {
+        s_schemeColorsWatcher->removeScheme(this);
+    }
 }
 
 QColor SchemeColors::backgroundColor() const
@@ -152,13 +281,7 @@ QString SchemeColors::possibleSchemeFile(QString scheme)
     QString tempScheme = scheme;
 
     if (scheme == "kdeglobals") {
-        QString settingsFile = QDir::homePath() + "/.config/kdeglobals";
-
-        if (QFileInfo(settingsFile).exists()) {
-            KSharedConfigPtr filePtr = KSharedConfig::openConfig(settingsFile);
-            KConfigGroup generalGroup = KConfigGroup(filePtr, "General");
-            tempScheme = generalGroup.readEntry("ColorScheme", "");
-        }
+        tempScheme = AppletDecoration::kdeglobalsColorScheme(scheme);
     }
 
     //! remove all whitespaces and "-" from scheme in order to access correctly its file
@@ -173,22 +296,7 @@ QString SchemeColors::schemeName(QString originalFile)
         return "";
     }
 
-    QString fileNameNoExt =  originalFile;
-
-    int lastSlash = originalFile.lastIndexOf("/");
-
-    if (lastSlash >= 0) {
-        fileNameNoExt.remove(0, lastSlash + 1);
-    }
-
-    if (fileNameNoExt.endsWith(".colors")) {
-        fileNameNoExt.remove(".colors");
-    }
-
-    KSharedConfigPtr filePtr = KSharedConfig::openConfig(originalFile);
-    KConfigGroup generalGroup = KConfigGroup(filePtr, "General");
-
-    return generalGroup.readEntry("Name", fileNameNoExt);
+    return schemeEntry(originalFile).name;
 }
 
 void SchemeColors::updateScheme()
@@ -197,29 +305,24 @@ void SchemeColors::updateScheme()
         return;
     }
 
-    KSharedConfigPtr filePtr = KSharedConfig::openConfig(m_schemeFile);
-    KConfigGroup wmGroup = KConfigGroup(filePtr, "WM");
-    KConfigGroup selGroup = KConfigGroup(filePtr, "Colors:Selection");
-    KConfigGroup viewGroup = KConfigGroup(filePtr, "Colors:View");
-    KConfigGroup windowGroup = KConfigGroup(filePtr, "Colors:Window");
-    KConfigGroup buttonGroup = KConfigGroup(filePtr, "Colors:Button");
+    const SchemesCache::Entry entry = schemeEntry(m_schemeFile);
 
-    m_activeBackgroundColor = windowGroup.readEntry("BackgroundNormal", QColor());
-    m_activeTextColor = windowGroup.readEntry("ForegroundNormal", QColor());
-    m_inactiveBackgroundColor = windowGroup.readEntry("BackgroundAlternate", QColor());
-    m_inactiveTextColor = windowGroup.readEntry("ForegroundInactive", QColor());
+    m_activeBackgroundColor = entry.colors[ActiveBackgroundColor];
+    m_activeTextColor = entry.colors[ActiveTextColor];
+    m_inactiveBackgroundColor = entry.colors[InactiveBackgroundColor];
+    m_inactiveTextColor = entry.colors[InactiveTextColor];
 
-    m_highlightColor = selGroup.readEntry("BackgroundNormal", QColor());
-    m_highlightedTextColor = selGroup.readEntry("ForegroundNormal", QColor());
+    m_highlightColor = entry.colors[HighlightColor];
+    m_highlightedTextColor = entry.colors[HighlightedTextColor];
 
-    m_positiveColor = selGroup.readEntry("ForegroundPositive", QColor());
-    m_neutralText = selGroup.readEntry("ForegroundNeutral", QColor());;
-    m_negativeText = selGroup.readEntry("ForegroundNegative", QColor());
+    m_positiveColor = entry.colors[PositiveColor];
+    m_neutralText = entry.colors[NeutralText];
+    m_negativeText = entry.colors[NegativeText];
 
-    m_buttonTextColor = buttonGroup.readEntry("ForegroundNormal", QColor());
-    m_buttonBackgroundColor = buttonGroup.readEntry("BackgroundNormal", QColor());
-    m_buttonHoverColor = buttonGroup.readEntry("DecorationHover", QColor());
-    m_buttonFocusColor = buttonGroup.readEntry("DecorationFocus", QColor());
+    m_buttonTextColor = entry.colors[ButtonTextColor];
+    m_buttonBackgroundColor = entry.colors[ButtonBackgroundColor];
+    m_buttonHoverColor = entry.colors[ButtonHoverColor];
+    m_buttonFocusColor = entry.colors[ButtonFocusColor];
 
     emit colorsChanged();
 }
@@ -79,6 +79,9 @@ signals:
 private slots:
     void updateScheme();
 
+private:
+    friend class SchemeColorsWatcher;
+
 private:
     bool m_basedOnPlasmaTheme{false};
 
@@ -0,0 +1,205 @@
+/*
+ * Copyright 2018  Michail Vourlakos <mvourlakos@gmail.com>
+ *
+ * This file is part of the libappletdecoration library
+ *
+ * Latte-Dock is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * Latte-Dock is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "schemescache.h"
+
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include <sys/stat.h>
+
+#define CACHEMAGIC 0x414d5343
+#define CACHEVERSION 2
+
+Q_GLOBAL_STATIC(SchemesCache, s_schemesCache)
+
+SchemesCache::SchemesCache()
+{
+    load();
+}
+
+SchemesCache::~SchemesCache()
+{
+}
+
+SchemesCache *SchemesCache::self()
+{
+    return s_schemesCache;
+}
+
+QString SchemesCache::cacheFile()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + "/windowappmenu/schemes.cache";
+}
+
+bool SchemesCache::stamp(const QString &file, Entry &entry)
+{
+    struct stat info;
+
+    if (::stat(QFile::encodeName(file).constData(), &info) != 0) {
+        return false;
+    }
+
+    entry.inode = info.st_ino;
+    entry.size = info.st_size;
+    entry.modified = qint64(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+    entry.changed = qint64(info.st_ctim.tv_sec) * 1000000000 + info.st_ctim.tv_nsec;
+
+    return true;
+}
+
+bool SchemesCache::sameStamp(const Entry &a, const Entry &b)
+{
+    return a.inode == b.inode
+            && a.size == b.size
+            && a.modified == b.modified
+            && a.changed == b.changed;
+}
+
+void SchemesCache::load()
+{
+    QFile file(cacheFile());
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    //! the index is small and every entry is copied into m_entries anyway,
+    //! so it is streamed from the file instead of being mapped
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_6);
+
+    quint32 magic{0};
+    quint32 version{0};
+    quint32 count{0};
+
+    stream >> magic >> version >> count;
+
+    if (magic != CACHEMAGIC || version != CACHEVERSION) {
+        return;
+    }
+
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        QString schemeFile;
+        Entry entry;
+
+        stream >> schemeFile >> entry.inode >> entry.size >> entry.modified >> entry.changed >> entry.name >> entry.colors;
+
+        if (stream.status() == QDataStream::Ok) {
+            m_entries[schemeFile] = entry;
+        }
+    }
+
+    if (stream.status() != QDataStream::Ok) {
+        qDebug() << "Discarding corrupted color schemes cache" << file.fileName();
+        m_entries.clear();
+    }
+}
+
+bool SchemesCache::find(const QString &file, Entry &entry) const
+{
+    Entry current;
+
+    if (!stamp(file, current)) {
+        return false;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    auto it = m_entries.constFind(file);
+
+    if (it == m_entries.constEnd() || !sameStamp(*it, current)) {
+        return false;
+    }
+
+    entry = *it;
+    return true;
+}
+
+void SchemesCache::insert(const QString &file, const Entry &entry)
+{
+    Entry current;
+
+    //! a rewrite during the parsing would otherwise store the old colors under
+    //! the stamp of the new file
+    if (!stamp(file, current) || !sameStamp(entry, current)) {
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_entries[file] = entry;
+    m_dirty = true;
+}
+
+void SchemesCache::save()
+{
+    QMutexLocker saveLocker(&m_saveMutex);
+
+    QHash<QString, Entry> entries;
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        if (!m_dirty) {
+            return;
+        }
+
+        entries = m_entries;
+        m_dirty = false;
+    }
+
+    //! forget schemes that have been uninstalled
+    for (auto it = entries.begin(); it != entries.end();) {
+        if (!QFileInfo::exists(it.key())) {
+            it = entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    QDir().mkpath(QFileInfo(cacheFile()).absolutePath());
+
+    QSaveFile file(cacheFile());
+    bool saved{false};
+
+    if (file.open(QIODevice::WriteOnly)) {
+        QDataStream stream(&file);
+        stream.setVersion(QDataStream::Qt_5_6);
+
+        stream << quint32(CACHEMAGIC) << quint32(CACHEVERSION) << quint32(entries.count());
+
+        for (auto it = entries.constBegin(); it != entries.constEnd(); ++it) {
+            stream << it.key() << it->inode << it->size << it->modified << it->changed << it->name << it->colors;
+        }
+
+        saved = file.commit();
+    }
+
+    if (!saved) {
+        //! written again on the next save
+        QMutexLocker locker(&m_mutex);
+        m_dirty = true;
+    }
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright 2018  Michail Vourlakos <mvourlakos@gmail.com>
+ *
+ * This file is part of the libappletdecoration library
+ *
+ * Latte-Dock is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * Latte-Dock is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SCHEMESCACHE_H
+#define SCHEMESCACHE_H
+
+#include <QColor>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+//! Persistent index of the parsed color schemes. Every entry is validated
+//! against the inode, size, modification and status change times of its scheme
+//! file, so opening the configuration dialog does not need to parse any
+//! unchanged scheme. A file that is replaced or rewritten with a restored
+//! modification time still changes its inode or status change time.
+//! It is used from the SchemesLoader worker threads and the GUI thread, it is
+//! only saved from the worker threads.
+class SchemesCache
+{
+public:
+    struct Entry {
+        quint64 inode{0};
+        qint64 size{0};
+        qint64 modified{0};
+        qint64 changed{0};
+        QString name;
+        QVector<QColor> colors;
+    };
+
+    SchemesCache();
+    ~SchemesCache();
+
+    static SchemesCache *self();
+
+    //! fills the file fields of entry, returns false when the file does not exist
+    static bool stamp(const QString &file, Entry &entry);
+
+    //! returns false when the file is not cached or it has changed since
+    bool find(const QString &file, Entry &entry) const;
+    //! entry must have been stamped before the file was parsed, it is dropped
+    //! when the file has been rewritten since
+    void insert(const QString &file, const Entry &entry);
+
+    //! writes the index back to disk when it has been modified
+    void save();
+
+private:
+    void load();
+
+    static QString cacheFile();
+    static bool sameStamp(const Entry &a, const Entry &b);
+
+private:
+    bool m_dirty{false};
+
+    mutable QMutex m_mutex;
+    //! serializes the writers, the entries stay available while one writes
+    QMutex m_saveMutex;
+    QHash<QString, Entry> m_entries;
+};
+
+#endif
@@ -0,0 +1,127 @@
+/*
+ * Copyright 2018  Michail Vourlakos <mvourlakos@gmail.com>
+ *
+ * This file is part of the libappletdecoration library
+ *
+ * Latte-Dock is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * Latte-Dock is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "schemesloader.h"
+
+#include "commontools.h"
+#include "schemecolors.h"
+#include "schemescache.h"
+
+#include <QCollator>
+#include <QDir>
+#include <QSet>
+#include <QThread>
+#include <QVector>
+
+#include <algorithm>
+
+#define BATCHSIZE 16
+
+SchemesLoader::SchemesLoader(QObject *parent)
+    : QObject(parent)
+{
+}
+
+SchemesLoader::~SchemesLoader()
+{
+    //! deleted in the worker thread when it finishes, so schemes that were
+    //! parsed for the shown rows while the dialog was open are saved there too
+    SchemesCache::self()->save();
+}
+
+bool SchemesLoader::isCanceled() const
+{
+    return QThread::currentThread()->isInterruptionRequested();
+}
+
+void SchemesLoader::load()
+{
+    QString currentSchemePath = SchemeColors::possibleSchemeFile("kdeglobals");
+    emit schemesFound({currentSchemePath}, {SchemeColors::schemeName(currentSchemePath)});
+
+    QStringList standardPaths = AppletDecoration::standardPathsFor("color-schemes");
+
+    QStringList files;
+    QStringList names;
+    QSet<QString> registeredSchemes;
+
+    for(auto path : standardPaths) {
+        QDir directory(path);
+        QStringList tempSchemes = directory.entryList(QStringList() << "*.colors" << "*.COLORS", QDir::Files);
+
+        foreach (QString filename, tempSchemes) {
+            //! reading a scheme name may parse the whole file
+            if (isCanceled()) {
+                return;
+            }
+
+            if (!registeredSchemes.contains(filename)) {
+                QString fullPath = path + "/" + filename;
+                files << fullPath;
+                names << SchemeColors::schemeName(fullPath);
+                registeredSchemes << filename;
+            }
+        }
+    }
+
+    //! sort once with precomputed collation keys, the model then only appends
+    QCollator collator;
+    collator.setCaseSensitivity(Qt::CaseInsensitive);
+
+    QVector<QCollatorSortKey> keys;
+    QVector<int> order;
+    keys.reserve(names.count());
+    order.reserve(names.count());
+
+    for (int i = 0; i < names.count(); ++i) {
+        keys << collator.sortKey(names[i]);
+        order << i;
+    }
+
+    std::stable_sort(order.begin(), order.end(), [&keys](int a, int b) {
+        return keys[a].compare(keys[b]) < 0;
+    });
+
+    QStringList batchFiles;
+    QStringList batchNames;
+
+    for (int i : order) {
+        batchFiles << files[i];
+        batchNames << names[i];
+
+        if (batchFiles.count() >= BATCHSIZE) {
+            if (isCanceled()) {
+                return;
+            }
+
+            emit schemesFound(batchFiles, batchNames);
+            batchFiles.clear();
+            batchNames.clear();
+        }
+    }
+
+    if (!batchFiles.isEmpty()) {
+        emit schemesFound(batchFiles, batchNames);
+    }
+
+    SchemesCache::self()->save();
+
+    emit finished();
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright 2018  Michail Vourlakos <mvourlakos@gmail.com>
+ *
+ * This file is part of the libappletdecoration library
+ *
+ * Latte-Dock is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * Latte-Dock is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SCHEMESLOADER_H
+#define SCHEMESLOADER_H
+
+#include <QObject>
+#include <QStringList>
+
+//! Scans the color-schemes directories and reads the scheme names. It lives
+//! in a worker thread of SchemesModel and delivers its results in batches.
+class SchemesLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SchemesLoader(QObject *parent = nullptr);
+    ~SchemesLoader() override;
+
+public slots:
+    void load();
+
+signals:
+    //! files and names have the same size, batches after the first one
+    //! are sorted by name and arrive in order
+    void schemesFound(const QStringList &files, const QStringList &names);
+    void finished();
+
+private:
+    //! the model requests an interruption when it is destroyed while loading
+    bool isCanceled() const;
+};
+
+#endif
@@ -22,19 +22,43 @@
 
 #include "commontools.h"
 #include "schemecolors.h"
+#include "schemesloader.h"
 
 #include <QDebug>
-#include <QDir>
+
+#include <algorithm>
 
 SchemesModel::SchemesModel(QObject *parent)
     : QAbstractListModel(parent)
 {
+    m_collator.setCaseSensitivity(Qt::CaseInsensitive);
+
+    //! the loader resolves the schemes directories in its own thread
+    AppletDecoration::initPathCache();
+
+    //! scanning and parsing all installed schemes must not block plasmashell
+    SchemesLoader *loader = new SchemesLoader();
+    loader->moveToThread(&m_loaderThread);
+
+    connect(&m_loaderThread, &QThread::finished, loader, &QObject::deleteLater);
+    connect(this, &SchemesModel::requestLoad, loader, &SchemesLoader::load);
+    connect(loader, &SchemesLoader::schemesFound, this, &SchemesModel::onSchemesFound);
+    connect(loader, &SchemesLoader::finished, this, &SchemesModel::onLoadingFinished);
+
+    m_loaderThread.start(QThread::LowPriority);
+
     initSchemes();
 }
 
 SchemesModel::~SchemesModel()
 {
-    qDeleteAll(m_schemes);
+    //! the loader stops at the next scheme, so closing the dialog while the
+    //! schemes are still loading does not wait for all of them
+    m_loaderThread.requestInterruption();
+    m_loaderThread.quit();
+    m_loaderThread.wait();
+
+    qDeleteAll(m_colors);
 }
 
 bool SchemesModel::currentOptionIsShown() const
@@ -52,13 +76,18 @@ void SchemesModel::setCurrentOptionIsShown(bool isShown)
     emit currentOptionIsShownChanged();
 }
 
+bool SchemesModel::loading() const
+{
+    return m_loading;
+}
+
 QVariant SchemesModel::data(const QModelIndex &index, int role) const
 {
     if (!index.isValid() || index.column() != 0 || index.row() < 0 || index.row() >= m_schemes.count()) {
         return QVariant();
     }
 
-    const SchemeColors *d = m_schemes[index.row()];
+    const SchemeItem &d = m_schemes[index.row()];
 
     switch (role) {
         case Qt::DisplayRole:
@@ -70,7 +99,7 @@ QVariant SchemesModel::data(const QModelIndex &index, int role) const
                 return "Current Window";
             }
 
-            return d->schemeName();
+            return d.name;
 
         case Qt::UserRole + 4:
             if (index.row() == 0) {
@@ -81,13 +110,13 @@ QVariant SchemesModel::data(const QModelIndex &index, int role) const
                 return "_current_";
             }
 
-            return d->schemeFile();
+            return d.file;
 
         case Qt::UserRole + 5:
-            return d->backgroundColor();
+            return colorsOf(index.row())->backgroundColor();
 
         case Qt::UserRole + 6:
-            return d->textColor();
+            return colorsOf(index.row())->textColor();
     }
 
     return QVariant();
@@ -116,59 +145,122 @@ QHash< int, QByteArray > SchemesModel::roleNames() const
 QColor SchemesModel::backgroundOf(const int &index) const
 {
     if (index>=0 && index<m_schemes.count()) {
-        return m_schemes[index]->backgroundColor();
+        return colorsOf(index)->backgroundColor();
     }
 
     return QColor("transparent");
 }
 
+SchemeColors *SchemesModel::colorsOf(int row) const
+{
+    const QString file = m_schemes[row].file;
+    SchemeColors *colors = m_colors.value(file);
+
+    if (!colors) {
+        SchemesModel *model = const_cast<SchemesModel *>(this);
+        colors = new SchemeColors(model, file);
+        m_colors[file] = colors;
+
+        connect(colors, &SchemeColors::colorsChanged, model, [model, file]() {
+            const int row = model->m_rows.value(file, -1);
+
+            if (row >= 0) {
+                emit model->dataChanged(model->index(row, 0), model->index(row, 0), {Qt::UserRole + 5, Qt::UserRole + 6});
+            }
+        });
+    }
+
+    return colors;
+}
+
 void SchemesModel::initSchemes()
 {
-    qDeleteAll(m_schemes);
+    beginResetModel();
     m_schemes.clear();
+    m_rows.clear();
+    endResetModel();
 
-    QString currentSchemePath = SchemeColors::possibleSchemeFile("kdeglobals");
-    insertSchemeInList(currentSchemePath);
+    qDeleteAll(m_colors);
+    m_colors.clear();
 
-    QStringList standardPaths = AppletDecoration::standardPathsFor("color-schemes");
+    if (!m_loading) {
+        m_loading = true;
+        emit loadingChanged();
+    }
 
-    QStringList registeredSchemes;
+    emit requestLoad();
+}
 
-    for(auto path : standardPaths) {
-        QDir directory(path);
-        QStringList tempSchemes = directory.entryList(QStringList() << "*.colors" << "*.COLORS", QDir::Files);
+void SchemesModel::onSchemesFound(const QStringList &files, const QStringList &names)
+{
+    if (files.isEmpty()) {
+        return;
+    }
 
-        foreach (QString filename, tempSchemes) {
-            if (!registeredSchemes.contains(filename)) {
-                QString fullPath = path + "/" + filename;
-                insertSchemeInList(fullPath);
-                registeredSchemes << filename;
-            }
+    const bool appendable = m_schemes.isEmpty()
+            || m_collator.compare(names.first(), m_schemes.last().name) >= 0;
+
+    if (!appendable) {
+        for (int i = 0; i < files.count(); ++i) {
+            insertSchemeInList(files[i], names[i]);
+        }
+
+        return;
+    }
+
+    //! batches are already sorted, so they are usually appended at once
+    const int first = m_schemes.count();
+
+    beginInsertRows(QModelIndex(), first, first + files.count() - 1);
+
+    for (int i = 0; i < files.count(); ++i) {
+        if (!m_rows.contains(files[i])) {
+            m_rows[files[i]] = m_schemes.count();
         }
+
+        m_schemes.append({files[i], names[i]});
     }
+
+    endInsertRows();
 }
 
-void SchemesModel::insertSchemeInList(QString file)
+void SchemesModel::onLoadingFinished()
 {
-    SchemeColors *tempScheme = new SchemeColors(this, file);
+    if (m_loading) {
+        m_loading = false;
+        emit loadingChanged();
+    }
+}
+
+void SchemesModel::insertSchemeInList(QString file, QString name)
+{
+    auto it = std::upper_bound(m_schemes.begin(), m_schemes.end(), name, [this](const QString &n, const SchemeItem &item) {
+        return m_collator.compare(n, item.name) < 0;
+    });
 
-    int atPos{0};
+    const int atPos = it - m_schemes.begin();
 
-    for (int i = 0; i < m_schemes.count(); i++) {
-        SchemeColors *s = m_schemes[i];
+    beginInsertRows(QModelIndex(), atPos, atPos);
+    m_schemes.insert(atPos, {file, name});
 
-        int result = QString::compare(tempScheme->schemeName(), s->schemeName(), Qt::CaseInsensitive);
+    //! only the rows after atPos moved. The current scheme is listed twice and
+    //! indexOf() returns its first row, so a row is only followed when it is
+    //! the first one of its file
+    for (int i = atPos + 1; i < m_schemes.count(); ++i) {
+        auto row = m_rows.find(m_schemes[i].file);
 
-        if (result < 0) {
-            atPos = i;
-            break;
-        } else {
-            atPos = i + 1;
+        if (row != m_rows.end() && *row == i - 1) {
+            *row = i;
         }
+    }
+
+    auto row = m_rows.find(file);
 
+    if (row == m_rows.end() || *row > atPos) {
+        m_rows[file] = atPos;
     }
 
-    m_schemes.insert(atPos, tempScheme);
+    endInsertRows();
 }
 
 int SchemesModel::indexOf(QString file)
@@ -181,14 +273,5 @@ int SchemesModel::indexOf(QString file)
         return 1;
     }
 
-    for (int i = 0; i < m_schemes.count(); i++) {
-        SchemeColors *s = m_schemes[i];
-
-        if (s->schemeFile() == file) {
-            return i;
-        }
-    }
-
-    return -1;
+    return m_rows.value(file, -1);
 }
-
@@ -22,6 +22,9 @@
 #define SCHEMESMODEL_H
 
 #include <QAbstractListModel>
+#include <QCollator>
+#include <QHash>
+#include <QThread>
 
 class SchemeColors;
 
@@ -29,6 +32,7 @@ class SchemesModel : public QAbstractListModel
 {
     Q_OBJECT
     Q_PROPERTY(bool currentOptionIsShown READ currentOptionIsShown WRITE setCurrentOptionIsShown NOTIFY currentOptionIsShownChanged)
+    Q_PROPERTY(bool loading READ loading NOTIFY loadingChanged)
 
 public:
     explicit SchemesModel(QObject *parent = nullptr);
@@ -41,22 +45,44 @@ public:
     bool currentOptionIsShown() const;
     void setCurrentOptionIsShown(bool isShown);
 
+    bool loading() const;
+
     Q_INVOKABLE int indexOf(QString file);
     Q_INVOKABLE QColor backgroundOf(const int &index) const;
 
 signals:
     void currentOptionIsShownChanged();
+    void loadingChanged();
+    void requestLoad();
 
 private slots:
     void initSchemes();
+    void onSchemesFound(const QStringList &files, const QStringList &names);
+    void onLoadingFinished();
 
 private:
-    void insertSchemeInList(QString file);
+    void insertSchemeInList(QString file, QString name);
+
+    //! colors are read only for the rows that are shown
+    SchemeColors *colorsOf(int row) const;
 
 private:
+    struct SchemeItem {
+        QString file;
+        QString name;
+    };
+
     bool m_currentOptionIsShown{false};
+    bool m_loading{false};
+
+    QCollator m_collator;
+
+    QList<SchemeItem> m_schemes;
+    //! file to row index
+    QHash<QString, int> m_rows;
+    mutable QHash<QString, SchemeColors *> m_colors;
 
-    QList<SchemeColors *> m_schemes;
+    QThread m_loaderThread;
 };
 
 #endif
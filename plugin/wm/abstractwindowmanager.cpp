@@ -36,6 +36,10 @@ AbstractWindowManager::~AbstractWindowManager()
 {
 }
 
+void AbstractWindowManager::resolveInitialWindow()
+{
+}
+
 bool AbstractWindowManager::filterByActive() const
 {
     return m_filterByActive;
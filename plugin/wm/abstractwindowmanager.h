@@ -64,6 +64,10 @@ public:
     WMData data() const;
     void setData(const WMData &data);
 
+    //! the window that provides the menu is resolved only after construction,
+    //! so that the panel is painted before any synchronous window queries
+    virtual void resolveInitialWindow();
+
 signals:
     void applicationMenuChanged(const QString &serviceName, const QString &menuObjectPath);
     void modelNeedsUpdate();
@@ -20,18 +20,15 @@
 #include "waylandwindowmanager.h"
 #include <config-appmenu.h>
 
+#include "../perf/latencystats.h"
+#include "../perf/tracer.h"
+
 //Qt
 #include <QDebug>
-#include <QModelIndex>
 
 // KDE
-#include <KWayland/Client/connection_thread.h>
-#include <KWayland/Client/registry.h>
 #include <KWindowSystem>
 
-// Plasma
-#include <taskmanager/abstracttasksmodel.h>
-
 #define DELAYEDMENUTIMER 2000
 
 namespace WM {
@@ -46,23 +43,13 @@ WaylandWindowManager::WaylandWindowManager(QObject *parent)
     }
 #endif
 
-    m_tasksModel = new TaskManager::TasksModel(this);
-
     setupWaylandIntegration();
 
     m_delayedApplicationMenuTimer.setSingleShot(true);
     m_delayedApplicationMenuTimer.setInterval(DELAYEDMENUTIMER);
     connect(&m_delayedApplicationMenuTimer, &QTimer::timeout, this, &WaylandWindowManager::onDelayedTimerTriggered);
 
-    m_tasksModel->setFilterByScreen(true);
-    connect(m_tasksModel, &TaskManager::TasksModel::activeTaskChanged, this, &WaylandWindowManager::onActiveWindowChanged);
-    connect(m_tasksModel, &TaskManager::TasksModel::activityChanged, this, &WaylandWindowManager::onActiveWindowChanged);
-    connect(m_tasksModel, &TaskManager::TasksModel::virtualDesktopChanged, this, &WaylandWindowManager::onActiveWindowChanged);
-    connect(m_tasksModel, &TaskManager::TasksModel::countChanged, this, &WaylandWindowManager::onActiveWindowChanged);
-
-    connect(this, &AbstractWindowManager::screenGeometryChanged, this, [this] {
-        m_tasksModel->setScreenGeometry(m_screenGeometry);
-    });
+    connect(this, &AbstractWindowManager::screenGeometryChanged, this, &WaylandWindowManager::onTrackedWindowChanged);
 
     connect(this, &AbstractWindowManager::winIdChanged, this, &WaylandWindowManager::onWinIdChanged);
 }
@@ -77,28 +64,36 @@ void WaylandWindowManager::setupWaylandIntegration()
         return;
     }
 
-    using namespace KWayland::Client;
-    auto connection = ConnectionThread::fromApplication(this);
+    //! all window managers of the process share the window management interface
+    m_tracker = WaylandWindowTracker::instance();
 
-    if (!connection) {
-        return;
+    if (m_tracker->windowManagement()) {
+        setupWindowManagement();
+    } else {
+        connect(m_tracker.data(), &WaylandWindowTracker::windowManagementAnnounced, this, &WaylandWindowManager::setupWindowManagement);
     }
+}
 
-    Registry *registry{new Registry(this)};
-    registry->create(connection);
+void WaylandWindowManager::setupWindowManagement()
+{
+    using namespace KWayland::Client;
 
-    connect(registry, &Registry::plasmaShellAnnounced, this
-            , [this, registry](quint32 name, quint32 version) {
-        m_waylandShell = registry->createPlasmaShell(name, version, this);
-    });
+    m_windowManagement = m_tracker->windowManagement();
 
-    QObject::connect(registry, &KWayland::Client::Registry::plasmaWindowManagementAnnounced,
-                     [this, registry](quint32 name, quint32 version) {
-        m_windowManagement = registry->createPlasmaWindowManagement(name, version, this);
+    //! only the active window is tracked instead of modelling all windows of the desktop
+    connect(m_windowManagement, &PlasmaWindowManagement::activeWindowChanged, this, &WaylandWindowManager::onActiveWindowChanged);
+    //! windows are announced asynchronously as well
+    connect(m_windowManagement, &PlasmaWindowManagement::windowCreated, this, [this]() {
+        if (hasUserWindowId() && !m_trackedWindow) {
+            onWinIdChanged();
+        }
     });
 
-    registry->setup();
-    connection->roundtrip();
+    if (hasUserWindowId()) {
+        onWinIdChanged();
+    } else {
+        onActiveWindowChanged();
+    }
 }
 
 KWayland::Client::PlasmaWindow *WaylandWindowManager::windowFor(QVariant wid)
@@ -116,17 +111,13 @@ KWayland::Client::PlasmaWindow *WaylandWindowManager::windowFor(QVariant wid)
 
 void WaylandWindowManager::onActiveWindowChanged()
 {
-    if (hasUserWindowId()) {
+    if (hasUserWindowId() || !m_windowManagement) {
         return;
     }
 
-#if LibTaskManager_CURRENTMINOR_VERSION >= 19
-    const QModelIndex activeTaskIndex = m_tasksModel->activeTask();
-    const QString objectPath = m_tasksModel->data(activeTaskIndex, TaskManager::AbstractTasksModel::ApplicationMenuObjectPath).toString();
-    const QString serviceName = m_tasksModel->data(activeTaskIndex, TaskManager::AbstractTasksModel::ApplicationMenuServiceName).toString();
+    Perf::LatencyStats::self()->mark(parent(), Perf::LatencyStats::ActiveWindowChanged);
 
-    validateApplicationMenu(objectPath, serviceName);
-#endif
+    trackWindow(m_windowManagement->activeWindow());
 }
 
 void WaylandWindowManager::onWinIdChanged()
@@ -135,26 +126,96 @@ void WaylandWindowManager::onWinIdChanged()
         return;
     }
 
-#if KF5_CURRENTMINOR_VERSION >= 69
     auto window = windowFor(m_userWindowId);
 
     if (window) {
-        const QString objectPath = window->applicationMenuObjectPath();
-        const QString serviceName = window->applicationMenuServiceName();
+        trackWindow(window);
+    }
+}
+
+void WaylandWindowManager::trackWindow(KWayland::Client::PlasmaWindow *window)
+{
+    using namespace KWayland::Client;
 
-        validateApplicationMenu(objectPath, serviceName);
+    if (m_trackedWindow != window) {
+        for (const auto &connection : m_trackedWindowConnections) {
+            disconnect(connection);
+        }
+
+        m_trackedWindowConnections.clear();
+        m_trackedWindow = window;
+
+        if (m_trackedWindow) {
+#if KF5_CURRENTMINOR_VERSION >= 69
+            m_trackedWindowConnections << connect(m_trackedWindow, &PlasmaWindow::applicationMenuChanged, this, &WaylandWindowManager::onTrackedWindowChanged);
+#endif
+            //! moves inside the same screen do not concern the menu, only crossing screens does
+            m_trackedWindowConnections << connect(m_trackedWindow, &PlasmaWindow::geometryChanged, this, [this]() {
+                if (isTrackedWindowOnScreen() != m_trackedWindowOnScreen) {
+                    onTrackedWindowChanged();
+                }
+            });
+            m_trackedWindowConnections << connect(m_trackedWindow, &PlasmaWindow::unmapped, this, [this]() {
+                trackWindow(nullptr);
+            });
+        }
+    }
+
+    onTrackedWindowChanged();
+}
+
+bool WaylandWindowManager::isTrackedWindowOnScreen() const
+{
+    if (!m_trackedWindow || !m_trackedWindow->isValid()) {
+        return false;
+    }
+
+    //! the window chosen from the plasmoid is followed in any screen
+    return hasUserWindowId()
+            || m_screenGeometry.isNull()
+            || m_screenGeometry.contains(m_trackedWindow->geometry().center());
+}
+
+void WaylandWindowManager::onTrackedWindowChanged()
+{
+    QString objectPath;
+    QString serviceName;
+
+    m_trackedWindowOnScreen = isTrackedWindowOnScreen();
+
+#if KF5_CURRENTMINOR_VERSION >= 69
+    if (m_trackedWindowOnScreen) {
+        objectPath = m_trackedWindow->applicationMenuObjectPath();
+        serviceName = m_trackedWindow->applicationMenuServiceName();
     }
 #endif
+
+    validateApplicationMenu(objectPath, serviceName);
 }
 
 void WaylandWindowManager::validateApplicationMenu(const QString &objectPath, const QString &serviceName)
 {
+    Perf::TraceSpan span("WaylandWindowManager::validateApplicationMenu");
+
     if (!objectPath.isEmpty() && !serviceName.isEmpty()) {
+        if (m_menuAvailable && m_visible && m_menuServiceName == serviceName && m_menuObjectPath == objectPath) {
+            //! the menu did not change e.g. focus returned to a window of the same menu,
+            //! the importer must not ping the application and the model must not be reset
+            Perf::LatencyStats::self()->increment(QStringLiteral("absorbedMenuNotifications"));
+            return;
+        }
+
+        m_menuServiceName = serviceName;
+        m_menuObjectPath = objectPath;
+
         setMenuAvailable(true);
         emit applicationMenuChanged(serviceName, objectPath);
         setVisible(true);
         emit modelNeedsUpdate();
     } else {
+        m_menuServiceName.clear();
+        m_menuObjectPath.clear();
+
         if (m_delayedMenuWindowId.toInt()<0) {
             m_delayedMenuWindowId = hasUserWindowId() ? m_userWindowId : 1/*flag case*/;
             m_delayedApplicationMenuTimer.start();
@@ -22,19 +22,18 @@
 
 //local
 #include "abstractwindowmanager.h"
+#include "waylandwindowtracker.h"
 
 //Qt
 #include <QObject>
+#include <QList>
 #include <QPointer>
+#include <QSharedPointer>
 #include <QTimer>
 
 // KDE
-#include <KWayland/Client/plasmashell.h>
 #include <KWayland/Client/plasmawindowmanagement.h>
 
-// Plasma TaskManager
-#include <taskmanager/tasksmodel.h>
-
 namespace WM {
 
 class WaylandWindowManager : public AbstractWindowManager
@@ -49,9 +48,13 @@ private slots:
     void onActiveWindowChanged();
     void onDelayedTimerTriggered();
     void onWinIdChanged();
+    void onTrackedWindowChanged();
+    void setupWindowManagement();
 
 private:
     void setupWaylandIntegration();
+    void trackWindow(KWayland::Client::PlasmaWindow *window);
+    bool isTrackedWindowOnScreen() const;
     void validateApplicationMenu(const QString &objectPath, const QString &serviceName);
 
 
@@ -62,10 +65,18 @@ private:
     QVariant m_delayedMenuWindowId{-1};
     QTimer m_delayedApplicationMenuTimer;
 
-    KWayland::Client::PlasmaShell *m_waylandShell{nullptr};
+    //! menu that was last sent to the model
+    QString m_menuServiceName;
+    QString m_menuObjectPath;
+
+    QSharedPointer<WaylandWindowTracker> m_tracker;
     QPointer<KWayland::Client::PlasmaWindowManagement> m_windowManagement;
 
-    TaskManager::TasksModel* m_tasksModel;
+    //! active window or the one chosen from the plasmoid
+    QPointer<KWayland::Client::PlasmaWindow> m_trackedWindow;
+    QList<QMetaObject::Connection> m_trackedWindowConnections;
+    //! whether the menu of the tracked window was offered last time
+    bool m_trackedWindowOnScreen{false};
 };
 
 }
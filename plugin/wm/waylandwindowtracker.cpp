@@ -0,0 +1,87 @@
+/*
+*  Copyright 2020 Michail Vourlakos <mvourlakos@gmail.com>
+*
+*  This file is part of Latte-Dock
+*
+*  Latte-Dock is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU General Public License as
+*  published by the Free Software Foundation; either version 2 of
+*  the License, or (at your option) any later version.
+*
+*  Latte-Dock is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "waylandwindowtracker.h"
+
+#include "../perf/latencystats.h"
+#include "../perf/tracer.h"
+
+// KDE
+#include <KWayland/Client/connection_thread.h>
+#include <KWayland/Client/registry.h>
+#include <KWindowSystem>
+
+namespace WM {
+
+QSharedPointer<WaylandWindowTracker> WaylandWindowTracker::instance()
+{
+    static QWeakPointer<WaylandWindowTracker> s_tracker;
+
+    QSharedPointer<WaylandWindowTracker> tracker = s_tracker.toStrongRef();
+
+    if (!tracker) {
+        tracker = QSharedPointer<WaylandWindowTracker>(new WaylandWindowTracker(), &QObject::deleteLater);
+        s_tracker = tracker;
+    }
+
+    return tracker;
+}
+
+WaylandWindowTracker::WaylandWindowTracker(QObject *parent)
+    : QObject(parent)
+{
+    if (!KWindowSystem::isPlatformWayland()) {
+        return;
+    }
+
+    using namespace KWayland::Client;
+    auto connection = ConnectionThread::fromApplication(this);
+
+    if (!connection) {
+        return;
+    }
+
+    Registry *registry{new Registry(this)};
+    registry->create(connection);
+
+    //! the registry is not waited for with a roundtrip, that would block plasmashell
+    //! until the compositor answers. Menus are resolved once window management is announced
+    const qint64 setupBegin = Perf::Tracer::now();
+
+    connect(registry, &Registry::plasmaWindowManagementAnnounced, this
+            , [this, registry, setupBegin](quint32 name, quint32 version) {
+        Perf::LatencyStats::self()->addSample(QStringLiteral("waylandWindowManagementAnnounced"), (Perf::Tracer::now() - setupBegin) / 1000);
+
+        m_windowManagement = registry->createPlasmaWindowManagement(name, version, this);
+        emit windowManagementAnnounced();
+    });
+
+    registry->setup();
+}
+
+WaylandWindowTracker::~WaylandWindowTracker()
+{
+}
+
+KWayland::Client::PlasmaWindowManagement *WaylandWindowTracker::windowManagement() const
+{
+    return m_windowManagement;
+}
+
+}
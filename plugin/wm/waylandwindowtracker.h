@@ -0,0 +1,60 @@
+/*
+*  Copyright 2020 Michail Vourlakos <mvourlakos@gmail.com>
+*
+*  This file is part of Latte-Dock
+*
+*  Latte-Dock is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU General Public License as
+*  published by the Free Software Foundation; either version 2 of
+*  the License, or (at your option) any later version.
+*
+*  Latte-Dock is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef WAYLANDWINDOWTRACKER_H
+#define WAYLANDWINDOWTRACKER_H
+
+//Qt
+#include <QObject>
+#include <QPointer>
+#include <QSharedPointer>
+
+// KDE
+#include <KWayland/Client/plasmawindowmanagement.h>
+
+namespace WM {
+
+//! The window management interface of the compositor, shared and reference
+//! counted between all the Wayland window managers of the process. Each
+//! window manager applies its own filtering (screen, user window) on top
+class WaylandWindowTracker : public QObject
+{
+    Q_OBJECT
+
+public:
+    static QSharedPointer<WaylandWindowTracker> instance();
+
+    ~WaylandWindowTracker() override;
+
+    //! nullptr until the compositor announced it
+    KWayland::Client::PlasmaWindowManagement *windowManagement() const;
+
+signals:
+    void windowManagementAnnounced();
+
+private:
+    explicit WaylandWindowTracker(QObject *parent = nullptr);
+
+private:
+    QPointer<KWayland::Client::PlasmaWindowManagement> m_windowManagement;
+};
+
+}
+
+#endif
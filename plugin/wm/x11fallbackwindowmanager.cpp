@@ -21,6 +21,11 @@
 
 #include <config-appmenu.h>
 
+#include "x11menuresolver.h"
+
+#include "../perf/latencystats.h"
+#include "../perf/tracer.h"
+
 #if HAVE_X11
 #include <QX11Info>
 #include <xcb/xcb.h>
@@ -28,13 +33,6 @@
 
 #include <QGuiApplication>
 
-static const QByteArray s_x11AppMenuServiceNamePropertyName = QByteArrayLiteral("_KDE_NET_WM_APPMENU_SERVICE_NAME");
-static const QByteArray s_x11AppMenuObjectPathPropertyName = QByteArrayLiteral("_KDE_NET_WM_APPMENU_OBJECT_PATH");
-
-#if HAVE_X11
-static QHash<QByteArray, xcb_atom_t> s_atoms;
-#endif
-
 namespace WM {
 
 X11FallbackWindowManager::X11FallbackWindowManager(QObject *parent)
@@ -69,14 +67,27 @@ X11FallbackWindowManager::X11FallbackWindowManager(QObject *parent)
         onWindowChanged(m_currentWindowId.toUInt());
     });
 
-    onActiveWindowChanged(KWindowSystem::activeWindow());
-
+    connect(X11MenuResolver::self(), &X11MenuResolver::resolved,
+            this, [this](QObject *requester, quint64 serial, const WM::X11MenuWindows &windows) {
+        if (requester == this) {
+            onMenuWindowsResolved(serial, windows);
+        }
+    });
 }
 
 X11FallbackWindowManager::~X11FallbackWindowManager()
 {
 }
 
+void X11FallbackWindowManager::resolveInitialWindow()
+{
+    if (!KWindowSystem::isPlatformX11()) {
+        return;
+    }
+
+    onActiveWindowChanged(KWindowSystem::activeWindow());
+}
+
 void X11FallbackWindowManager::onWindowChanged(WId id)
 {
     if (m_currentWindowId == id) {
@@ -114,6 +125,9 @@ void X11FallbackWindowManager::filterWindow(KWindowInfo &info)
 
 void X11FallbackWindowManager::onActiveWindowChanged(WId id)
 {
+    Perf::TraceSpan span("X11FallbackWindowManager::onActiveWindowChanged");
+    Perf::LatencyStats::self()->mark(parent(), Perf::LatencyStats::ActiveWindowChanged);
+
     qApp->removeNativeEventFilter(this);
 
     if (hasUserWindowId()  && m_userWindowId!=id) {
@@ -122,130 +136,102 @@ void X11FallbackWindowManager::onActiveWindowChanged(WId id)
     }
 
     if (!id) {
+        //! drop any resolution that is still pending
+        ++m_resolveSerial;
         setMenuAvailable(false);
         emit modelNeedsUpdate();
         return;
     }
 
-#if HAVE_X11
-
     if (KWindowSystem::isPlatformX11()) {
-        auto *c = QX11Info::connection();
-
-        auto getWindowPropertyString = [c, this](WId id, const QByteArray & name) -> QByteArray {
-            QByteArray value;
-
-            if (!s_atoms.contains(name))
-            {
-                const xcb_intern_atom_cookie_t atomCookie = xcb_intern_atom(c, false, name.length(), name.constData());
-                QScopedPointer<xcb_intern_atom_reply_t, QScopedPointerPodDeleter> atomReply(xcb_intern_atom_reply(c, atomCookie, nullptr));
-
-                if (atomReply.isNull()) {
-                    return value;
-                }
-
-                s_atoms[name] = atomReply->atom;
-
-                if (s_atoms[name] == XCB_ATOM_NONE) {
-                    return value;
-                }
-            }
-
-            static const long MAX_PROP_SIZE = 10000;
-            auto propertyCookie = xcb_get_property(c, false, id, s_atoms[name], XCB_ATOM_STRING, 0, MAX_PROP_SIZE);
-            QScopedPointer<xcb_get_property_reply_t, QScopedPointerPodDeleter> propertyReply(xcb_get_property_reply(c, propertyCookie, nullptr));
+        m_resolveTimer.start();
 
-            if (propertyReply.isNull())
-            {
-                return value;
-            }
-
-            if (propertyReply->type == XCB_ATOM_STRING && propertyReply->format == 8 && propertyReply->value_len > 0)
-            {
-                const char *data = (const char *) xcb_get_property_value(propertyReply.data());
-                int len = propertyReply->value_len;
-
-                if (data) {
-                    value = QByteArray(data, data[len - 1] ? len : len - 1);
-                }
-            }
-
-            return value;
-        };
-
-        auto updateMenuFromWindowIfHasMenu = [this, &getWindowPropertyString](WId id) {
-            const QString serviceName = QString::fromUtf8(getWindowPropertyString(id, s_x11AppMenuServiceNamePropertyName));
-            const QString menuObjectPath = QString::fromUtf8(getWindowPropertyString(id, s_x11AppMenuObjectPathPropertyName));
-
-            if (!serviceName.isEmpty() && !menuObjectPath.isEmpty()) {
-                emit applicationMenuChanged(serviceName, menuObjectPath);
-                return true;
-            }
-
-            return false;
-        };
-
-        KWindowInfo info(id, NET::WMState | NET::WMWindowType | NET::WMGeometry, NET::WM2TransientFor);
-
-        if (info.hasState(NET::SkipTaskbar) ||
-                info.windowType(NET::UtilityMask) == NET::Utility ||
-                info.windowType(NET::DesktopMask) == NET::Desktop) {
-
-            //! hide when the windows or their transiet(s) do not have a menu
-            if (filterByActive()) {
+        // monitor whether an app menu becomes available later
+        // this can happen when an app starts, shows its window, and only later announces global menu (e.g. Firefox)
+        //! installed before the properties are read, the announcement may arrive
+        //! while the worker thread has already read them
+        m_delayedMenuWindowId = id;
+        qApp->installNativeEventFilter(this);
 
-                KWindowInfo transientInfo = KWindowInfo(info.transientFor(), NET::WMState | NET::WMWindowType | NET::WMGeometry, NET::WM2TransientFor);
+        if (X11MenuResolver::self()->isValid()) {
+            //! the properties are read in a worker thread, only the latest request is applied
+            X11MenuResolver::self()->resolve(this, ++m_resolveSerial, id);
+        } else {
+#if HAVE_X11
+            onMenuWindowsResolved(++m_resolveSerial, X11MenuResolver::self()->readMenuWindows(QX11Info::connection(), id));
+#endif
+        }
+    }
+}
 
-                while (transientInfo.win()) {
-                    if (transientInfo.win() == m_currentWindowId) {
-                        filterWindow(info);
-                        return;
-                    }
+void X11FallbackWindowManager::onMenuWindowsResolved(quint64 serial, const X11MenuWindows &windows)
+{
+    if (serial != m_resolveSerial || windows.isEmpty()) {
+        return;
+    }
 
-                    transientInfo = KWindowInfo(transientInfo.transientFor(), NET::WMState | NET::WMWindowType | NET::WMGeometry, NET::WM2TransientFor);
-                }
-            }
+    Perf::TraceSpan span("X11FallbackWindowManager::onMenuWindowsResolved");
+    Perf::LatencyStats::self()->addSample(QStringLiteral("x11MenuResolution"), m_resolveTimer.nsecsElapsed() / 1000);
 
-            if (filterByActive()) {
-                setVisible(false);
-            }
+    const WId id = windows.first().id;
 
-            return;
+    auto updateMenuFromWindowIfHasMenu = [this](const X11MenuWindow &window) {
+        if (window.hasMenu()) {
+            qApp->removeNativeEventFilter(this);
+            emit applicationMenuChanged(window.serviceName, window.objectPath);
+            return true;
         }
 
-        m_currentWindowId = id;
-
-        if (!filterChildren()) {
-            KWindowInfo transientInfo = KWindowInfo(info.transientFor(), NET::WMState | NET::WMWindowType | NET::WMGeometry, NET::WM2TransientFor);
-
-            // look at transient windows first
-            while (transientInfo.win()) {
-                if (updateMenuFromWindowIfHasMenu(transientInfo.win())) {
+        return false;
+    };
+
+    //! still a round trip on the gui connection, filterWindow() needs the
+    //! geometry and the minimized state that KWindowInfo provides
+    KWindowInfo info(id, NET::WMState | NET::WMWindowType | NET::WMGeometry);
+
+    if (info.hasState(NET::SkipTaskbar) ||
+            info.windowType(NET::UtilityMask) == NET::Utility ||
+            info.windowType(NET::DesktopMask) == NET::Desktop) {
+        //! such windows never provide the menu themselves
+        qApp->removeNativeEventFilter(this);
+
+        //! hide when the windows or their transiet(s) do not have a menu
+        if (filterByActive()) {
+            for (int i = 1; i < windows.count(); ++i) {
+                if (windows[i].id == m_currentWindowId) {
                     filterWindow(info);
                     return;
                 }
-
-                transientInfo = KWindowInfo(transientInfo.transientFor(), NET::WMState | NET::WMWindowType | NET::WMGeometry, NET::WM2TransientFor);
             }
         }
 
-        if (updateMenuFromWindowIfHasMenu(id)) {
-            filterWindow(info);
-            return;
+        if (filterByActive()) {
+            setVisible(false);
         }
 
-        // monitor whether an app menu becomes available later
-        // this can happen when an app starts, shows its window, and only later announces global menu (e.g. Firefox)
-        qApp->installNativeEventFilter(this);
-        m_delayedMenuWindowId = id;
+        return;
+    }
 
-        //no menu found, set it to unavailable
-        setMenuAvailable(false);
-        emit modelNeedsUpdate();
+    m_currentWindowId = id;
+
+    if (!filterChildren()) {
+        // look at transient windows first
+        for (int i = 1; i < windows.count(); ++i) {
+            if (updateMenuFromWindowIfHasMenu(windows[i])) {
+                filterWindow(info);
+                return;
+            }
+        }
     }
 
-#endif
+    if (updateMenuFromWindowIfHasMenu(windows.first())) {
+        filterWindow(info);
+        return;
+    }
 
+    //no menu found, set it to unavailable
+    setMenuAvailable(false);
+    emit modelNeedsUpdate();
 }
 
 bool X11FallbackWindowManager::nativeEventFilter(const QByteArray &eventType, void *message, long *result)
@@ -265,10 +251,10 @@ bool X11FallbackWindowManager::nativeEventFilter(const QByteArray &eventType, vo
 
         if (event->window == m_delayedMenuWindowId) {
 
-            auto serviceNameAtom = s_atoms.value(s_x11AppMenuServiceNamePropertyName);
-            auto objectPathAtom = s_atoms.value(s_x11AppMenuObjectPathPropertyName);
+            auto serviceNameAtom = X11MenuResolver::self()->serviceNameAtom();
+            auto objectPathAtom = X11MenuResolver::self()->objectPathAtom();
 
-            if (serviceNameAtom != XCB_ATOM_NONE && objectPathAtom != XCB_ATOM_NONE) { // shouldn't happen
+            if (serviceNameAtom != XCB_ATOM_NONE && objectPathAtom != XCB_ATOM_NONE) { // only without an X server
                 if (event->atom == serviceNameAtom || event->atom == objectPathAtom) {
                     // see if we now have a menu
                     onActiveWindowChanged(KWindowSystem::activeWindow());
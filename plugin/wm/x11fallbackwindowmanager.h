@@ -21,9 +21,11 @@
 
 //local
 #include "abstractwindowmanager.h"
+#include "x11menuresolver.h"
 
 //Qt
 #include <QAbstractNativeEventFilter>
+#include <QElapsedTimer>
 #include <QObject>
 #include <KWindowSystem>
 
@@ -37,6 +39,8 @@ public:
     explicit X11FallbackWindowManager(QObject *parent = nullptr);
     ~X11FallbackWindowManager() override;
 
+    void resolveInitialWindow() override;
+
 protected:
     bool nativeEventFilter(const QByteArray &eventType, void *message, long int *result) override;
 
@@ -49,10 +53,17 @@ private Q_SLOTS:
     void onWindowRemoved(WId id);
     void filterWindow(KWindowInfo &info);
 
+private:
+    void onMenuWindowsResolved(quint64 serial, const X11MenuWindows &windows);
+
 private:
     //! window that its menu initialization may be delayed
     QVariant m_delayedMenuWindowId{-1};
 
+    //! identifies the latest request to the X11MenuResolver
+    quint64 m_resolveSerial{0};
+    QElapsedTimer m_resolveTimer;
+
 };
 
 }
@@ -0,0 +1,244 @@
+/*
+*  Copyright 2020 Michail Vourlakos <mvourlakos@gmail.com>
+*
+*  This file is part of Latte-Dock
+*
+*  Latte-Dock is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU General Public License as
+*  published by the Free Software Foundation; either version 2 of
+*  the License, or (at your option) any later version.
+*
+*  Latte-Dock is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "x11menuresolver.h"
+
+#include <config-appmenu.h>
+
+#include "../perf/tracer.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QScopedPointer>
+#include <QSet>
+#include <QThread>
+
+#if HAVE_X11
+#include <QX11Info>
+#include <xcb/xcb.h>
+//! after the Qt headers, Xlib defines macros such as None and Status
+#include <X11/Xlib.h>
+#endif
+
+#define MAXPROPERTYSIZE 10000
+
+static const QByteArray s_x11AppMenuServiceNamePropertyName = QByteArrayLiteral("_KDE_NET_WM_APPMENU_SERVICE_NAME");
+static const QByteArray s_x11AppMenuObjectPathPropertyName = QByteArrayLiteral("_KDE_NET_WM_APPMENU_OBJECT_PATH");
+
+namespace WM {
+
+#if HAVE_X11
+namespace {
+//! a missing reply, e.g. BadWindow for a window that is already gone, is reported as false
+template<typename Reply>
+bool checkReply(const QScopedPointer<Reply, QScopedPointerPodDeleter> &reply, xcb_generic_error_t *error)
+{
+    QScopedPointer<xcb_generic_error_t, QScopedPointerPodDeleter> errorGuard(error);
+    return !reply.isNull() && errorGuard.isNull();
+}
+
+QString stringProperty(xcb_connection_t *c, xcb_get_property_cookie_t cookie)
+{
+    xcb_generic_error_t *error{nullptr};
+    QScopedPointer<xcb_get_property_reply_t, QScopedPointerPodDeleter> reply(xcb_get_property_reply(c, cookie, &error));
+
+    if (!checkReply(reply, error) || reply->type != XCB_ATOM_STRING || reply->format != 8 || reply->value_len == 0) {
+        return QString();
+    }
+
+    const char *data = (const char *) xcb_get_property_value(reply.data());
+    int len = reply->value_len;
+
+    if (!data) {
+        return QString();
+    }
+
+    return QString::fromUtf8(data, data[len - 1] ? len : len - 1);
+}
+
+quint32 windowProperty(xcb_connection_t *c, xcb_get_property_cookie_t cookie)
+{
+    xcb_generic_error_t *error{nullptr};
+    QScopedPointer<xcb_get_property_reply_t, QScopedPointerPodDeleter> reply(xcb_get_property_reply(c, cookie, &error));
+
+    if (!checkReply(reply, error) || reply->type != XCB_ATOM_WINDOW || reply->format != 32 || reply->value_len == 0) {
+        return XCB_WINDOW_NONE;
+    }
+
+    return *static_cast<xcb_window_t *>(xcb_get_property_value(reply.data()));
+}
+
+quint32 internAtom(xcb_connection_t *c, xcb_intern_atom_cookie_t cookie)
+{
+    xcb_generic_error_t *error{nullptr};
+    QScopedPointer<xcb_intern_atom_reply_t, QScopedPointerPodDeleter> reply(xcb_intern_atom_reply(c, cookie, &error));
+
+    if (!checkReply(reply, error)) {
+        return XCB_ATOM_NONE;
+    }
+
+    return reply->atom;
+}
+}
+#endif
+
+X11MenuResolver *X11MenuResolver::self()
+{
+    //! the resolver is deleted by its own thread, which is stopped before the
+    //! application is destroyed
+    static X11MenuResolver *s_resolver{nullptr};
+
+    if (!s_resolver) {
+        qRegisterMetaType<WM::X11MenuWindows>();
+
+        QThread *thread = new QThread;
+        thread->setObjectName(QStringLiteral("X11MenuResolver"));
+
+        s_resolver = new X11MenuResolver;
+        s_resolver->moveToThread(thread);
+        QObject::connect(thread, &QThread::finished, s_resolver, &QObject::deleteLater);
+        thread->start();
+
+        qAddPostRoutine([]() {
+            QThread *thread = s_resolver->thread();
+            thread->quit();
+            thread->wait();
+            delete thread;
+            s_resolver = nullptr;
+        });
+    }
+
+    return s_resolver;
+}
+
+X11MenuResolver::X11MenuResolver()
+    : QObject(nullptr)
+{
+#if HAVE_X11
+    //! the display that the application opened, e.g. through -display, instead of $DISPLAY
+    Display *display = QX11Info::display();
+    xcb_connection_t *c = xcb_connect(display ? XDisplayString(display) : nullptr, nullptr);
+
+    if (xcb_connection_has_error(c)) {
+        qWarning() << "X11MenuResolver: private xcb connection failed, menus are resolved in the gui thread";
+        xcb_disconnect(c);
+
+        //! the atoms are still needed by the gui thread
+        c = QX11Info::connection();
+    } else {
+        m_connection = c;
+    }
+
+    //! atoms are global to the server, so they are valid on every connection. They are
+    //! interned here, before the first focus change, so that PropertyNotify events of the
+    //! gui thread can always be matched against them
+    if (c) {
+        const xcb_intern_atom_cookie_t serviceNameCookie = xcb_intern_atom(c, false,
+                                                                           s_x11AppMenuServiceNamePropertyName.length(),
+                                                                           s_x11AppMenuServiceNamePropertyName.constData());
+        const xcb_intern_atom_cookie_t objectPathCookie = xcb_intern_atom(c, false,
+                                                                          s_x11AppMenuObjectPathPropertyName.length(),
+                                                                          s_x11AppMenuObjectPathPropertyName.constData());
+
+        m_serviceNameAtom = internAtom(c, serviceNameCookie);
+        m_objectPathAtom = internAtom(c, objectPathCookie);
+    }
+#endif
+
+    //! posted from the gui thread, so it is queued into the worker thread
+    connect(this, &X11MenuResolver::resolvePosted, this, &X11MenuResolver::onResolvePosted);
+}
+
+X11MenuResolver::~X11MenuResolver()
+{
+#if HAVE_X11
+    if (m_connection) {
+        xcb_disconnect(m_connection);
+    }
+#endif
+}
+
+bool X11MenuResolver::isValid() const
+{
+    return m_connection != nullptr;
+}
+
+quint32 X11MenuResolver::serviceNameAtom() const
+{
+    return m_serviceNameAtom;
+}
+
+quint32 X11MenuResolver::objectPathAtom() const
+{
+    return m_objectPathAtom;
+}
+
+void X11MenuResolver::resolve(QObject *requester, quint64 serial, quint32 window)
+{
+    emit resolvePosted(requester, serial, window);
+}
+
+X11MenuWindows X11MenuResolver::readMenuWindows(xcb_connection_t *c, quint32 window) const
+{
+    X11MenuWindows windows;
+
+#if HAVE_X11
+    if (c && !xcb_connection_has_error(c) && m_serviceNameAtom != XCB_ATOM_NONE && m_objectPathAtom != XCB_ATOM_NONE) {
+        QSet<quint32> visited;
+        quint32 id = window;
+
+        while (id != XCB_WINDOW_NONE && !visited.contains(id)) {
+            visited << id;
+
+            //! all the properties of a window are requested together, so every
+            //! window of the chain costs a single round trip
+            auto transientCookie = xcb_get_property(c, false, id, XCB_ATOM_WM_TRANSIENT_FOR, XCB_ATOM_WINDOW, 0, 1);
+            auto serviceNameCookie = xcb_get_property(c, false, id, m_serviceNameAtom, XCB_ATOM_STRING, 0, MAXPROPERTYSIZE);
+            auto objectPathCookie = xcb_get_property(c, false, id, m_objectPathAtom, XCB_ATOM_STRING, 0, MAXPROPERTYSIZE);
+
+            X11MenuWindow menuWindow;
+            menuWindow.id = id;
+            menuWindow.serviceName = stringProperty(c, serviceNameCookie);
+            menuWindow.objectPath = stringProperty(c, objectPathCookie);
+            windows << menuWindow;
+
+            id = windowProperty(c, transientCookie);
+        }
+    }
+#else
+    Q_UNUSED(c);
+#endif
+
+    if (windows.isEmpty()) {
+        X11MenuWindow menuWindow;
+        menuWindow.id = window;
+        windows << menuWindow;
+    }
+
+    return windows;
+}
+
+void X11MenuResolver::onResolvePosted(QObject *requester, quint64 serial, quint32 window)
+{
+    Perf::TraceSpan span("X11MenuResolver::resolve");
+
+    emit resolved(requester, serial, readMenuWindows(m_connection, window));
+}
+
+}
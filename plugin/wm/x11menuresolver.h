@@ -0,0 +1,95 @@
+/*
+*  Copyright 2020 Michail Vourlakos <mvourlakos@gmail.com>
+*
+*  This file is part of Latte-Dock
+*
+*  Latte-Dock is free software; you can redistribute it and/or
+*  modify it under the terms of the GNU General Public License as
+*  published by the Free Software Foundation; either version 2 of
+*  the License, or (at your option) any later version.
+*
+*  Latte-Dock is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU General Public License for more details.
+*
+*  You should have received a copy of the GNU General Public License
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef X11MENURESOLVER_H
+#define X11MENURESOLVER_H
+
+//Qt
+#include <QObject>
+#include <QString>
+#include <QVector>
+
+struct xcb_connection_t;
+
+namespace WM {
+
+struct X11MenuWindow
+{
+    quint32 id{0};
+    QString serviceName;
+    QString objectPath;
+
+    bool hasMenu() const {
+        return !serviceName.isEmpty() && !objectPath.isEmpty();
+    }
+};
+
+//! the requested window first and then its transient parents, nearest first
+using X11MenuWindows = QVector<X11MenuWindow>;
+
+//! Reads the appmenu properties of a window and of its WM_TRANSIENT_FOR
+//! chain through a private xcb connection in a worker thread, so a slow
+//! X server can not block the gui thread that shares QX11Info::connection()
+class X11MenuResolver : public QObject
+{
+    Q_OBJECT
+
+public:
+    static X11MenuResolver *self();
+
+    //! false when no private connection could be opened, resolve() must not be
+    //! used then and readMenuWindows() is called from the gui thread instead
+    bool isValid() const;
+
+    //! the result is delivered through resolved()
+    void resolve(QObject *requester, quint64 serial, quint32 window);
+
+    //! blocking, the requested window is always the first one
+    X11MenuWindows readMenuWindows(xcb_connection_t *c, quint32 window) const;
+
+    //! interned during construction, XCB_ATOM_NONE only when the server is unreachable
+    quint32 serviceNameAtom() const;
+    quint32 objectPathAtom() const;
+
+signals:
+    void resolved(QObject *requester, quint64 serial, const WM::X11MenuWindows &windows);
+
+    //! carries the requests of the gui thread to the worker thread
+    void resolvePosted(QObject *requester, quint64 serial, quint32 window);
+
+private slots:
+    void onResolvePosted(QObject *requester, quint64 serial, quint32 window);
+
+private:
+    X11MenuResolver();
+    ~X11MenuResolver() override;
+
+private:
+    xcb_connection_t *m_connection{nullptr};
+
+    //! written only before the worker thread starts
+    quint32 m_serviceNameAtom{0};
+    quint32 m_objectPathAtom{0};
+};
+
+}
+
+Q_DECLARE_METATYPE(WM::X11MenuWindows)
+
+#endif